@@ -0,0 +1,151 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Edge-adaptive mode: march a grid with one sample per 4x4 block first,
+// then only spend more rays on blocks where the corners disagree.
+constexpr int BLOCK = 4;
+constexpr int BLOCKS_X = OUTPUT_WIDTH / BLOCK;
+constexpr int BLOCKS_Y = OUTPUT_HEIGHT / BLOCK;
+static_assert(OUTPUT_WIDTH % BLOCK == 0 && OUTPUT_HEIGHT % BLOCK == 0);
+
+// corners include the right/bottom edge, which are marched but not written
+constexpr int CORNERS_X = BLOCKS_X + 1;
+constexpr int CORNERS_Y = BLOCKS_Y + 1;
+
+// max. summed channel difference of the corners that is still interpolated
+constexpr int COLOR_THRESHOLD = 6;
+
+enum class Refine : uint8_t { NONE, HALF, FULL };
+
+struct Sample {
+  uint16_t x;
+  uint8_t y;
+  uint8_t size;
+};
+
+constinit uint16_t cornerColor[CORNERS_Y][CORNERS_X]{};
+constinit uint16_t cornerDepth[CORNERS_Y][CORNERS_X]{};
+// refinement samples of one block-row, worst case is every block at full-res
+constinit Sample samples[BLOCKS_X * (BLOCK*BLOCK - 1)]{};
+
+/**
+ * Decides how many rays a block needs based on its four corners.
+ * Hit/miss mixes are silhouettes and get fully marched, depth changes get half-res,
+ * smooth surfaces (or sky) are interpolated unless the shading changes too much.
+ */
+template<SDFConf CONF>
+Refine classifyBlock(const uint16_t z[4], const uint16_t c[4])
+{
+  uint32_t zMin = std::min(std::min(z[0], z[1]), std::min(z[2], z[3]));
+  uint32_t zMax = std::max(std::max(z[0], z[1]), std::max(z[2], z[3]));
+
+  if(zMax == DEPTH_MISS) {
+    if(zMin != DEPTH_MISS)return Refine::FULL;
+    if constexpr (!CONF.shadeNoHit)return Refine::NONE;
+  } else {
+    uint32_t zRange = zMax - zMin;
+    if(zRange * 4 >= zMin)return Refine::FULL;
+    if(zRange * 16 >= zMin)return Refine::HALF;
+  }
+
+  int colorDiff = std::max(
+    std::max(Color::distance(c[0], c[1]), Color::distance(c[0], c[2])),
+    std::max(Color::distance(c[0], c[3]), Color::distance(c[1], c[2]))
+  );
+  return colorDiff > COLOR_THRESHOLD ? Refine::HALF : Refine::NONE;
+}
+
+/**
+ * Draws the frame adaptively, returns the line up to which blocks were refined.
+ * With a frame-budget set, blocks after that are only interpolated from the corners.
+ */
+template<SDFConf CONF>
+int drawAdaptive(void* fb)
+{
+  fm_vec3_t camPos = camera.camPos;
+  fm_vec3_t camDir = camera.camDir;
+  auto buff = (uint16_t*)((char*)fb + (OFFSET_Y * FB_STRIDE) + OFFSET_X*2);
+
+  for(int j=0; j<CORNERS_Y; ++j) {
+    auto rowDir = rayStepY * (float)(j * BLOCK) + rayDirOrigin;
+    auto stepDir = rayStepX * (float)BLOCK;
+    marchSamples<CONF>(CORNERS_X,
+      [&](int i) { return rowDir + stepDir * (float)i; },
+      [&](int i, float distTotal, const fm_vec3_t &dir, int material) {
+        cornerDepth[j][i] = toDepth(distTotal, dir, camDir);
+        cornerColor[j][i] = shadeSample<CONF>(distTotal, dir, camPos, material);
+      }
+    );
+  }
+
+  uint32_t ticksRefineStart = TICKS_READ();
+  bool refine = true;
+  int lineRefined = OUTPUT_HEIGHT;
+
+  for(int j=0; j<BLOCKS_Y; ++j)
+  {
+    if(frameBudget != 0 && refine && j != 0) {
+      // once the projection fails the rest is interpolated
+      if(isOverBudget(ticksRefineStart, j, BLOCKS_Y - j)) {
+        refine = false;
+        lineRefined = j * BLOCK;
+      }
+    }
+
+    uint16_t *buffRow = buff + j * BLOCK * (FB_STRIDE/2);
+    int sampleCount = 0;
+
+    auto addSample = [&](int x, int y, int size) {
+      samples[sampleCount++] = {(uint16_t)x, (uint8_t)y, (uint8_t)size};
+    };
+
+    for(int i=0; i<BLOCKS_X; ++i)
+    {
+      const uint16_t z[4]{cornerDepth[j][i], cornerDepth[j][i+1], cornerDepth[j+1][i], cornerDepth[j+1][i+1]};
+      const uint16_t c[4]{cornerColor[j][i], cornerColor[j][i+1], cornerColor[j+1][i], cornerColor[j+1][i+1]};
+      uint16_t *buffBlock = buffRow + i * BLOCK;
+
+      auto type = refine ? classifyBlock<CONF>(z, c) : Refine::NONE;
+      int x = i * BLOCK;
+      int y = j * BLOCK;
+
+      // the top-left pixel is the corner itself, which is reused in all modes
+      if(type == Refine::NONE) {
+        interpolateBlock<BLOCK>(buffBlock, c[0], c[1], c[2], c[3]);
+      } else if(type == Refine::HALF) {
+        writeBlock<2>(buffBlock, c[0]);
+        addSample(x+2, y,   2);
+        addSample(x,   y+2, 2);
+        addSample(x+2, y+2, 2);
+      } else {
+        buffBlock[0] = c[0];
+        for(int v=0; v<BLOCK; ++v) {
+          for(int u=0; u<BLOCK; ++u) {
+            if(u != 0 || v != 0)addSample(x+u, y+v, 1);
+          }
+        }
+      }
+    }
+
+    marchSamples<CONF>(sampleCount,
+      [&](int s) {
+        return rayDirOrigin + rayStepX * (float)samples[s].x + rayStepY * (float)samples[s].y;
+      },
+      [&](int s, float distTotal, const fm_vec3_t &dir, int material) {
+        auto &sample = samples[s];
+        uint16_t color = shadeSample<CONF>(distTotal, dir, camPos, material);
+        uint16_t *px = buff + sample.y * (FB_STRIDE/2) + sample.x;
+        if(sample.size == 2) {
+          writeBlock<2>(px, color);
+        } else {
+          px[0] = color;
+        }
+      }
+    );
+  }
+
+  return lineRefined;
+}
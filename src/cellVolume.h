@@ -0,0 +1,72 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Ambient-occlusion volume of one unit-cell, for scenes repeating their SDF in every cell.
+// Static lighting terms are then the same in all cells and can be baked once at init,
+// shaders only need a lookup at 'fastClamp(hitPos)', see 'Stage::CellAO'.
+constexpr int CELL_VOL_DIM = 32;
+
+constinit uint8_t cellAO[CELL_VOL_DIM][CELL_VOL_DIM][CELL_VOL_DIM]{};
+
+inline int cellVolIndex(float v) {
+  return std::min((int)((v + 0.5f) * CELL_VOL_DIM), CELL_VOL_DIM-1);
+}
+
+/**
+ * Bakes the AO of the repeated SDF, 'fnSDF' is evaluated in the cell-space (like the CPU SDFs expect).
+ * Texels take the AO of the closest surface point, those too far from any surface are never sampled and skipped.
+ * To not evaluate all texels, the SDF is first checked at the center of each block of 4^3 texels:
+ * since it never over-estimates the distance, no texel of a block far enough away can be close to a surface.
+ */
+inline void bakeCellAO(FuncSDF fnSDF, FuncNorm fnNorm)
+{
+  auto sdfRepeat = [&](const fm_vec3_t &p) { return fnSDF(Math::fastClamp(p)); };
+  constexpr float TEXEL = 1.0f / CELL_VOL_DIM;
+  constexpr float MAX_SURFACE_DIST = TEXEL * 2.0f;
+
+  constexpr int BLOCK = 4;
+  // from the block center to the center of its corner texels
+  constexpr float BLOCK_RADIUS = (BLOCK - 1) * 0.5f * TEXEL * 1.7321f;
+  auto texelPos = [](float x, float y, float z) {
+    return fm_vec3_t{(x + 0.5f) * TEXEL - 0.5f, (y + 0.5f) * TEXEL - 0.5f, (z + 0.5f) * TEXEL - 0.5f};
+  };
+
+  memset(cellAO, 0xFF, sizeof(cellAO));
+
+  for(int bz=0; bz<CELL_VOL_DIM; bz+=BLOCK) {
+    for(int by=0; by<CELL_VOL_DIM; by+=BLOCK) {
+      for(int bx=0; bx<CELL_VOL_DIM; bx+=BLOCK) {
+        constexpr float CENTER = (BLOCK - 1) * 0.5f;
+        float distBlock = sdfRepeat(texelPos(bx + CENTER, by + CENTER, bz + CENTER));
+        if(fabsf(distBlock) > MAX_SURFACE_DIST + BLOCK_RADIUS)continue;
+
+        for(int z=bz; z<bz+BLOCK; ++z) {
+          for(int y=by; y<by+BLOCK; ++y) {
+            for(int x=bx; x<bx+BLOCK; ++x) {
+              fm_vec3_t p = texelPos(x, y, z);
+              float dist = sdfRepeat(p);
+              if(fabsf(dist) > MAX_SURFACE_DIST)continue;
+
+              auto norm = fnNorm(p);
+              p -= norm * dist;
+
+              // compare the SDF along the normal to the distance if nothing was there,
+              // samples reach far enough to see the neighbours in the next cells
+              float occ = 0;
+              float weight = 1.0f;
+              for(int i=0; i<5; ++i) {
+                float h = 0.05f + 0.1f * i;
+                occ += (h - sdfRepeat(p + norm * h)) * weight;
+                weight *= 0.6f;
+              }
+              cellAO[z][y][x] = (uint8_t)(Math::clamp(1.0f - occ * 3.0f, 0.0f, 1.0f) * 255.0f);
+            }
+          }
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,68 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Fixed-point color math for the shaders: channels are 5.8 (0 - 31*256), factors are 0.8 (0 - 256).
+// Results truncate like the '(int)' casts of the float shaders, so they stay within one LSB of them.
+// Only the factors coming from float lighting need a conversion, the channels never leave the GPRs.
+//
+// All three channels share one 64-bit GPR in 21-bit lanes (SWAR), so scaling or mixing a color
+// is one multiply(-add) for all of them. A 5.8 channel times a factor still fits into its lane,
+// products with a sum of weights of at most 'ONE' (e.g. 'mix') can't carry into the next one either.
+namespace ColorFP
+{
+  constexpr int32_t ONE = 256;
+
+  constexpr int LANE_BITS = 21;
+  constexpr uint64_t LANES = 1 | (1ull << LANE_BITS) | (1ull << (LANE_BITS*2));
+  // mask of a 5.8 channel, after a product got shifted back
+  constexpr uint64_t CHANNEL_MASK = 0x1FFF * LANES;
+  static_assert(31ull * ONE * ONE < (1ull << LANE_BITS));
+
+  struct RGB {
+    uint64_t v;
+
+    constexpr int32_t r() const { return (int32_t)(v >> (LANE_BITS*2)); }
+    constexpr int32_t g() const { return (int32_t)(v >> LANE_BITS) & 0x1FFF; }
+    constexpr int32_t b() const { return (int32_t)v & 0x1FFF; }
+  };
+
+  inline int32_t factor(float f) {
+    return (int32_t)(f * (float)ONE);
+  }
+
+  // from channels that are already fixed-point
+  constexpr RGB fromFP(int32_t r, int32_t g, int32_t b) {
+    return {((uint64_t)r << (LANE_BITS*2)) | ((uint64_t)g << LANE_BITS) | (uint64_t)b};
+  }
+
+  constexpr RGB fromInt(int32_t r, int32_t g, int32_t b) {
+    return fromFP(r * ONE, g * ONE, b * ONE);
+  }
+
+  // 'f' can go above 'ONE' for darker colors, as long as each product still fits into its lane
+  constexpr RGB scale(const RGB &c, int32_t f) {
+    return {((c.v * (uint64_t)f) >> 8) & CHANNEL_MASK};
+  }
+
+  // 'a' at t=0, 'b' at t=ONE, same as 'a + (b-a)*t' but without the signed difference per channel
+  constexpr RGB mix(const RGB &a, const RGB &b, int32_t t) {
+    return {((a.v * (uint64_t)(ONE - t) + b.v * (uint64_t)t) >> 8) & CHANNEL_MASK};
+  }
+
+  constexpr RGB WHITE = fromInt(31, 31, 31);
+
+  // 'WHITE' minus the color, no lane can borrow from the next one
+  constexpr RGB invert(const RGB &c) {
+    return {WHITE.v - c.v};
+  }
+
+  constexpr uint16_t pack(const RGB &c) {
+    return ((c.r() >> 8) << 11) | ((c.g() >> 8) << 6) | ((c.b() >> 8) << 1);
+  }
+  static_assert(pack(fromInt(31, 1, 31)) == 0b11111'00001'11111'0);
+  static_assert(pack(mix(fromInt(31, 0, 10), fromInt(1, 30, 20), ONE/2)) == 0b10000'01111'01111'0);
+  static_assert(pack(scale(fromInt(31, 16, 2), ONE/2)) == 0b01111'01000'00001'0);
+}
@@ -0,0 +1,44 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#include "dynamicRes.h"
+
+namespace
+{
+  // required frames below the threshold before switching to a higher resolution
+  constexpr int FRAMES_TO_SCALE_UP = 8;
+  // predicted time (in 1/16th of the target) a higher resolution must stay below
+  constexpr uint64_t SCALE_UP_THRESHOLD = 12;
+
+  constexpr uint64_t predictTicks(uint32_t ticks, int levelFrom, int levelTo) {
+    return (uint64_t)ticks * DynamicRes::LEVELS[levelTo].cost / DynamicRes::LEVELS[levelFrom].cost;
+  }
+}
+
+int DynamicRes::update(uint32_t ticks)
+{
+  if(ticks > targetTicks) {
+    framesBelow = 0;
+    // jump directly to the first resolution that is predicted to make it
+    int levelCurr = level;
+    while(level < LEVEL_COUNT-1) {
+      ++level;
+      if(predictTicks(ticks, levelCurr, level) <= targetTicks)break;
+    }
+    return level;
+  }
+
+  if(level > 0) {
+    uint64_t predicted = predictTicks(ticks, level, level-1);
+    if(predicted * 16 < targetTicks * SCALE_UP_THRESHOLD) {
+      if(++framesBelow >= FRAMES_TO_SCALE_UP) {
+        --level;
+        framesBelow = 0;
+      }
+    } else {
+      framesBelow = 0;
+    }
+  }
+  return level;
+}
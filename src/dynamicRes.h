@@ -0,0 +1,42 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+#include <libdragon.h>
+#include "raymarch.h"
+
+/**
+ * Closed-loop controller picking the resolution level to hit a target frame time.
+ * It switches to a lower resolution as soon as a frame is over the target,
+ * but only goes back up after the predicted time has been well below it for a few frames.
+ */
+struct DynamicRes
+{
+  struct Level {
+    int scaling;
+    RayMarch::Mode mode;
+    uint32_t cost; // relative time of a frame, 64 is full-res
+    const char *name;
+  };
+
+  // ordered from highest to lowest quality
+  static constexpr Level LEVELS[] = {
+    {1, RayMarch::Mode::SCALED,       64, "Full"},
+    {1, RayMarch::Mode::CHECKERBOARD, 36, "Chkr"},
+    {1, RayMarch::Mode::ADAPTIVE,     24, "Adpt"},
+    {2, RayMarch::Mode::SCALED,       16, "1/2x"},
+    {3, RayMarch::Mode::SCALED,        7, "1/3x"},
+    {4, RayMarch::Mode::SCALED,        4, "1/4x"},
+  };
+  static constexpr int LEVEL_COUNT = sizeof(LEVELS) / sizeof(LEVELS[0]);
+
+  uint32_t targetTicks{};
+  int level{3};
+  int framesBelow{};
+
+  /**
+   * Takes the ticks the last frame took at the current level, returns the level for the next one.
+   */
+  int update(uint32_t ticks);
+};
@@ -0,0 +1,24 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Lighting per face for SDFs with a finite set of normals ('SDFConf::faces').
+// It uses the camera direction instead of each ray, so the faces stay flat-shaded,
+// hits then only need the face index to get their light.
+constexpr int MAX_FACES = 8;
+
+constinit int32_t faceLight[MAX_FACES]{};
+
+/**
+ * Bakes the light of all faces, must be called after 'setupFrame()'.
+ */
+template<SDFConf CONF>
+void updateFaceCache()
+{
+  static_assert(CONF.faces->count <= MAX_FACES);
+  for(int i=0; i<CONF.faces->count; ++i) {
+    faceLight[i] = CONF.faces->fnLight(CONF.faces->normals[i], camera.camDir);
+  }
+}
@@ -0,0 +1,128 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Point lights for 'Stage::TileLights', each pixel only iterates the lights in 'tileLightMask'
+// that also reach its screen tile in 'lightGrid'. Outside of 'drawTiledLights()' the mask contains all lights,
+// inside it is set per tile and already includes the tile's 'lightGrid' entry.
+constexpr int MAX_LIGHTS = 16;
+
+struct PointLight {
+  fm_vec3_t pos;
+  fm_vec3_t color; // 0-1
+  float range;
+};
+
+constinit PointLight lights[MAX_LIGHTS]{};
+constinit int lightCount = 0;
+constinit uint32_t tileLightMask = 0;
+constinit bool tileLightMaskHasGrid = false; // set by 'drawTiledLights()', pixels can skip 'lightGridMask()'
+
+// per 16x16 pixel tile: lights whose range intersects the tile's frustum (see 'updateLightGrid()')
+constexpr int LIGHT_TILE = 16;
+constexpr int LIGHT_TILES_X = (OUTPUT_WIDTH + LIGHT_TILE - 1) / LIGHT_TILE;
+constexpr int LIGHT_TILES_Y = (OUTPUT_HEIGHT + LIGHT_TILE - 1) / LIGHT_TILE;
+static_assert(MAX_LIGHTS <= 16);
+
+constinit uint16_t lightGrid[LIGHT_TILES_Y][LIGHT_TILES_X]{};
+
+inline void setLightCount(int count) {
+  lightCount = count;
+  tileLightMask = (1u << count) - 1;
+}
+
+/**
+ * Returns the lights whose range overlaps the box between 'bbMin' and 'bbMax'.
+ */
+inline uint32_t cullLights(const fm_vec3_t &bbMin, const fm_vec3_t &bbMax)
+{
+  uint32_t mask = 0;
+  for(int i=0; i<lightCount; ++i) {
+    const auto &pos = lights[i].pos;
+    // squared distance from the light to the closest point in the box
+    float distSq = 0;
+    for(int a=0; a<3; ++a) {
+      float d = fmaxf(bbMin.v[a] - pos.v[a], 0) + fmaxf(pos.v[a] - bbMax.v[a], 0);
+      distSq += d * d;
+    }
+    if(distSq < lights[i].range * lights[i].range)mask |= 1u << i;
+  }
+  return mask;
+}
+
+/**
+ * Culls the lights against the frustum of each screen tile, must be called after 'setupFrame()'.
+ * This doesn't need any depth, so it works for all modes and resolutions.
+ * Tiles are padded by a pixel, to stay conservative for sub-pixel jittered rays.
+ */
+inline void updateLightGrid()
+{
+  fm_vec3_t camPos = camera.camPos;
+
+  // angular radius of each light as seen from the camera, or all tiles if it is inside of it
+  struct LightCone { fm_vec3_t dir; float sinR; float cosR; bool inside; };
+  LightCone cones[MAX_LIGHTS];
+  uint32_t maskVisible = 0;
+  for(int i=0; i<lightCount; ++i) {
+    fm_vec3_t toLight = lights[i].pos - camPos;
+    float dist = Math::length(toLight);
+    float range = lights[i].range;
+    if(dist - range >= renderDist)continue; // nothing it can reach gets hit
+    maskVisible |= 1u << i;
+
+    auto &cone = cones[i];
+    cone.inside = dist <= range;
+    if(cone.inside)continue;
+    cone.dir = toLight / dist;
+    cone.sinR = range / dist;
+    cone.cosR = sqrtf(1.0f - cone.sinR * cone.sinR);
+  }
+
+  for(int ty=0; ty<LIGHT_TILES_Y; ++ty) {
+    float y0 = ty * LIGHT_TILE - 1.0f;
+    float y1 = std::min((ty + 1) * LIGHT_TILE, OUTPUT_HEIGHT) + 1.0f;
+    for(int tx=0; tx<LIGHT_TILES_X; ++tx) {
+      float x0 = tx * LIGHT_TILE - 1.0f;
+      float x1 = std::min((tx + 1) * LIGHT_TILE, OUTPUT_WIDTH) + 1.0f;
+
+      // bounding cone of the tile, around its center ray
+      auto axis = Math::normalizeUnsafe(rayDirOrigin + rayStepX * ((x0 + x1) * 0.5f) + rayStepY * ((y0 + y1) * 0.5f));
+      float cosT = 1.0f;
+      for(float x : {x0, x1}) {
+        for(float y : {y0, y1}) {
+          auto corner = Math::normalizeUnsafe(rayDirOrigin + rayStepX * x + rayStepY * y);
+          cosT = fminf(cosT, Math::dot(corner, axis));
+        }
+      }
+      float sinT = sqrtf(1.0f - cosT * cosT);
+
+      // cones intersect if the angle between them is below the sum of both half-angles
+      uint32_t mask = 0;
+      uint32_t maskTest = maskVisible;
+      while(maskTest) {
+        int i = __builtin_ctz(maskTest);
+        maskTest &= maskTest - 1;
+        const auto &cone = cones[i];
+        if(cone.inside || Math::dot(cone.dir, axis) >= cosT * cone.cosR - sinT * cone.sinR) {
+          mask |= 1u << i;
+        }
+      }
+      lightGrid[ty][tx] = mask;
+    }
+  }
+}
+
+/**
+ * Lights of the screen tile a (normalized) ray direction goes through.
+ */
+inline uint32_t lightGridMask(const fm_vec3_t &dir)
+{
+  float zInv = OUTPUT_HEIGHT / Math::dot(dir, camera.camDir);
+  int x = (int)(Math::dot(dir, right) * zInv + (OUTPUT_WIDTH / 2));
+  int y = (int)(Math::dot(dir, up) * zInv + (OUTPUT_HEIGHT / 2));
+  x = std::clamp(x, 0, OUTPUT_WIDTH-1);
+  y = std::clamp(y, 0, OUTPUT_HEIGHT-1);
+  return lightGrid[y / LIGHT_TILE][x / LIGHT_TILE];
+}
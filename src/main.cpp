@@ -4,9 +4,12 @@
 */
 #include <libdragon.h>
 #include <initializer_list>
+#include <iterator>
 #include "text.h"
 #include "main.h"
 #include "raymarch.h"
+#include "present.h"
+#include "dynamicRes.h"
 #include "camera/flyCam.h"
 #include "math/mathFloat.h"
 
@@ -14,11 +17,17 @@ constinit FlyCam camera{};
 
 namespace {
 
-  constinit uint32_t frame = 0;
   constinit float currTime = 0.0f;
-  constinit int resolution = 1;
+  constinit int resLevel = 0;
   constinit bool freeCam = true;
   constinit int redrawMenu = 4;
+  constinit int budgetIdx = 0;
+  constinit bool autoRes = false;
+  constinit bool animate = true;
+  constinit DynamicRes dynRes{};
+
+  constexpr uint32_t FRAME_BUDGETS_MS[] = {0, 50, 33, 20};
+  constexpr uint32_t AUTO_RES_TARGET_MS = 33;
 
   constexpr int MAX_SDF_IDX = 8;
   int sdfIdx = MAX_SDF_IDX-1;
@@ -83,6 +92,8 @@ int main()
     vi_set_divot(false);
     vi_set_gamma(VI_GAMMA_DISABLE);
 
+    Present::init(fbs, 3);
+
     RayMarch::init();
 
     camera.setRotation(0.1f, 2.8f);
@@ -92,23 +103,36 @@ int main()
     for(auto& fb : fbs) {
       memset(fb.buffer, 0, fb.width * fb.height * 2);
     }
-
     vi_show(&fbs[0]);
   }
 
   for(;;)
   {
-    float deltaTime = 0.1f / resolution;
+    float deltaTime = 0.1f / DynamicRes::LEVELS[resLevel].scaling;
+
+    auto showProgress = [](){
+      // for full-res without pacing we intentionally keep drawing into the visible buffer
+      // to see the progress in real time, everything else goes through the present queue
+      return resLevel == 0 && !autoRes && Present::getPacing() == Present::Pacing::NONE;
+    };
 
-    auto markMenuRedraw = [](){
-      redrawMenu = (resolution > 1) ? 4 : 1;
+    auto markMenuRedraw = [&](){
+      redrawMenu = showProgress() ? 1 : 4;
     };
 
     joypad_poll();
     auto press = joypad_get_buttons_pressed(JOYPAD_PORT_1);
     if(press.a || press.b) {
-      if (press.a && resolution < 4)resolution *= 2;
-      if (press.b && resolution > 1)resolution /= 2;
+      if (press.a) {
+        if(resLevel < DynamicRes::LEVEL_COUNT-1)++resLevel;
+        else autoRes = true;
+      }
+      if (press.b) {
+        if(autoRes)autoRes = false;
+        else if(resLevel > 0)--resLevel;
+      }
+      dynRes.level = resLevel;
+      dynRes.framesBelow = 0;
       markMenuRedraw();
       vi_wait_vblank();
     }
@@ -117,16 +141,23 @@ int main()
     if(press.r) { ++sdfIdx; markMenuRedraw(); currTime = 0; }
 
     if(press.start)freeCam = !freeCam;
+    if(press.d_right)animate = !animate;
 
-    if(sdfIdx < 0)sdfIdx = MAX_SDF_IDX;
-    if(sdfIdx > MAX_SDF_IDX)sdfIdx = 0;
+    if(press.d_down) {
+      auto pacing = (int)Present::getPacing() + 1;
+      if(pacing > (int)Present::Pacing::HZ_20)pacing = 0;
+      Present::setPacing((Present::Pacing)pacing);
+      markMenuRedraw();
+    }
 
-    if(resolution > 1) {
-      // low-res mode is fast enough to afford proper buffering.
-      // for high-res we intentionally keep the same buffer to see the progress in real time
-      frame = (frame + 1) % 3;
+    if(press.d_left) {
+      budgetIdx = (budgetIdx + 1) % std::size(FRAME_BUDGETS_MS);
+      RayMarch::setFrameBudget(TICKS_FROM_MS(FRAME_BUDGETS_MS[budgetIdx]));
     }
 
+    if(sdfIdx < 0)sdfIdx = MAX_SDF_IDX;
+    if(sdfIdx > MAX_SDF_IDX)sdfIdx = 0;
+
     if(freeCam) {
       camera.update(deltaTime);
     } else {
@@ -138,34 +169,69 @@ int main()
       camera.camDir = Math::normalize(fm_vec3_t{0,0,0} - camera.camPos);
     }
 
-    auto fb = &fbs[frame];
+    if(animate)currTime += deltaTime;
+
+    const auto &res = DynamicRes::LEVELS[resLevel];
+    // drawing into the visible buffer, refine the whole screen at once instead of top to bottom
+    RayMarch::setMode(showProgress() ? RayMarch::Mode::PROGRESSIVE : res.mode);
+
+    // nothing changed: keep showing the last frame and refine it in-place
+    bool isStatic = RayMarch::isStatic(currTime, sdfIdx, res.scaling);
+
+    auto fb = (showProgress() || isStatic) ? Present::front() : Present::acquire();
     Text::setFrameBuffer(*fb);
 
     if(redrawMenu != 0) {
       Text::printf(120, 222, "[L/R] SDF:%d", sdfIdx);
-      switch (resolution) {
-        default:
-        case 1: Text::print(230, 222, "[A/B] Full"); break;
-        case 2: Text::print(230, 222, "[A/B] 1/2x"); break;
-        case 4: Text::print(230, 222, "[A/B] 1/4x"); break;
-      }
+      Text::printf(222, 222, autoRes ? "[A/B] A:%s" : "[A/B] %s  ", DynamicRes::LEVELS[resLevel].name);
       --redrawMenu;
     }
 
-    currTime += deltaTime;
-
     disable_interrupts();
 
       auto ticks = get_ticks();
-      RayMarch::draw(fb->buffer, currTime, sdfIdx, resolution);
+      if(isStatic) {
+        RayMarch::accumulate(fb->buffer, sdfIdx);
+      } else {
+        RayMarch::draw(fb->buffer, currTime, sdfIdx, res.scaling);
+      }
       ticks = get_ticks() - ticks;
 
     enable_interrupts();
 
-    Text::printf(16, 222, "%.2fms``", TICKS_TO_US(ticks) * (1.0f / 1000.0f));
+    if(isStatic) {
+      Text::printf(16, 222, "Acc:%-5d", RayMarch::getAccumulatedFrames());
+    } else {
+      Text::printf(16, 222, "%.2fms``", TICKS_TO_US(ticks) * (1.0f / 1000.0f));
+    }
+    if(Present::getPacing() == Present::Pacing::NONE) {
+      Text::print(16, 4, "[v] Sync:Off       ");
+    } else {
+      Text::printf(16, 4, "[v] Sync:%-2d Miss:%-4lu",
+        60 / (int)Present::getPacing(), Present::getMissedFrames()
+      );
+    }
 
-    // Note that we never check if the VI is done with the current buffer
-    // this is fine since we are sadly never faster than 60FPS
-    vi_show(fb);
+    if(FRAME_BUDGETS_MS[budgetIdx] == 0) {
+      Text::print(176, 4, "[<] Budget:Off  ");
+    } else {
+      Text::printf(176, 4, "[<] %lums Deg:%-3d",
+        FRAME_BUDGETS_MS[budgetIdx], RayMarch::getDegradedLines()
+      );
+    }
+
+    if(!showProgress() && !isStatic)Present::submit(fb);
+
+    if(autoRes && !isStatic) {
+      // aim a bit below the budget, so it only has to catch outliers
+      uint32_t budgetMs = FRAME_BUDGETS_MS[budgetIdx];
+      dynRes.targetTicks = budgetMs ? (TICKS_FROM_MS(budgetMs) * 7 / 8) : TICKS_FROM_MS(AUTO_RES_TARGET_MS);
+
+      int newLevel = dynRes.update(ticks);
+      if(newLevel != resLevel) {
+        resLevel = newLevel;
+        markMenuRedraw();
+      }
+    }
   }
 }
@@ -24,9 +24,12 @@ namespace {
 
   static_assert(OUTPUT_WIDTH % 2 == 0); // 3-pixel step in inner loop...
   static_assert((OUTPUT_WIDTH/4) % 2 == 0); // ...same in low res mode
+  static_assert(OUTPUT_WIDTH % 6 == 0); // 1/3 res mode (height gets clipped)
 
   constexpr uint32_t TEXTURE_DIM = 256;
-  constexpr uint32_t TEXTURE_BYTES = TEXTURE_DIM * TEXTURE_DIM * 4;
+  // texture + mip-chain down to 4x4, see 'Tex::MIP_LEVELS' (the chain would continue with 2x2)
+  constexpr uint32_t TEXTURE_TEXELS = (TEXTURE_DIM * TEXTURE_DIM - 2*2) * 4 / 3;
+  constexpr uint32_t TEXTURE_BYTES = TEXTURE_TEXELS * 4;
 }
 
 namespace MemMap
@@ -35,20 +38,29 @@ namespace MemMap
   constexpr uint32_t FB1 = 0xA014'0000;
   constexpr uint32_t FB2 = 0xA018'0000;
 
+  // textures including their mip-chain ('TEXTURE_BYTES')
   constexpr uint32_t TEX0 = 0xA01C'0000;
   constexpr uint32_t TEX0_CACHED = 0x801C'0000;
 
-  constexpr uint32_t TEX1 = 0xA020'0000;
-  constexpr uint32_t TEX1_CACHED = 0x8020'0000;
+  constexpr uint32_t TEX1 = 0xA021'6000;
+  constexpr uint32_t TEX1_CACHED = 0x8021'6000;
 
-  constexpr uint32_t TEX2 = 0xA024'0000;
-  constexpr uint32_t TEX2_CACHED = 0x8024'0000;
+  constexpr uint32_t TEX2 = 0xA026'C000;
+  constexpr uint32_t TEX2_CACHED = 0x8026'C000;
 
-  constexpr uint32_t TEX3 = 0xA028'0000;
-  constexpr uint32_t TEX3_CACHED = 0x8028'0000;
+  constexpr uint32_t TEX3 = 0xA02C'2000;
+  constexpr uint32_t TEX3_CACHED = 0x802C'2000;
 
-  constexpr uint32_t TEX_SKY = 0xA02C'0000;
-  constexpr uint32_t TEX_SKY_CACHED = 0x802C'0000;
+  constexpr uint32_t TEX_SKY = 0xA031'8000;
+  constexpr uint32_t TEX_SKY_CACHED = 0x8031'8000;
+
+  // per-pixel depth of the current/last frame
+  constexpr uint32_t DEPTH0_CACHED = 0x803C'0000;
+  constexpr uint32_t DEPTH1_CACHED = 0x803E'0000;
+  constexpr uint32_t DEPTH_BYTES = 0x2'0000;
+
+  static_assert(TEX1 - TEX0 >= TEXTURE_BYTES && TEX2 - TEX1 >= TEXTURE_BYTES);
+  static_assert(TEX3 - TEX2 >= TEXTURE_BYTES && TEX_SKY - TEX3 >= TEXTURE_BYTES);
 
 }
 
@@ -146,6 +146,15 @@ namespace Math
     return std::bit_cast<float>(i);
   }
 
+  // Newton iteration, only meant for tables generated at compile-time
+  constexpr float sqrtConst(float x)
+  {
+    if(x <= 0.0f)return 0.0f;
+    float r = x > 1.0f ? x : 1.0f;
+    for(int i=0; i<32; ++i)r = 0.5f * (r + x / r);
+    return r;
+  }
+
   inline float dot(const fm_vec3_t& a, const fm_vec3_t& b) {
       return a.x*b.x + a.y*b.y + a.z*b.z;
   }
@@ -0,0 +1,98 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Shading LUT indexed by the (octahedral) world-space normal, for shaders where the color
+// only depends on the normal and the camera basis, e.g. the env-maps.
+// When the camera rotates all entries become stale, they are then shaded again on their first lookup.
+// So a rotation only costs the cells hits actually land in, instead of re-baking the whole LUT.
+// The LUT is already coarser than the textures, so it uses a fixed mip-level instead of a per-pixel one.
+constexpr int NORMAL_LUT_DIM = 64;
+constexpr int NORMAL_LUT_MIP = 2;
+
+constinit uint16_t normalLut[NORMAL_LUT_DIM * NORMAL_LUT_DIM]{};
+// epoch each entry was shaded in, it is stale if that is not 'normalLutEpochCurr'
+constinit uint8_t normalLutEpoch[NORMAL_LUT_DIM * NORMAL_LUT_DIM]{};
+constinit uint8_t normalLutEpochCurr{0};
+constinit fm_vec3_t normalLutDir{};
+constinit FuncNormalLut normalLutFunc{nullptr};
+
+inline int normalLutIndex(const fm_vec3_t &norm)
+{
+  constexpr float UV_SCALE = NORMAL_LUT_DIM * 0.5f;
+  float u, v;
+  octaProject(norm, u, v);
+  int x = std::min((int)((u + 1.0f) * UV_SCALE), NORMAL_LUT_DIM-1);
+  int y = std::min((int)((v + 1.0f) * UV_SCALE), NORMAL_LUT_DIM-1);
+  return y * NORMAL_LUT_DIM + x;
+}
+
+// inverse of 'octaProject()' at the center of a cell
+inline fm_vec3_t normalLutCellNormal(int idx)
+{
+  constexpr float STEP = 2.0f / NORMAL_LUT_DIM;
+  float u = ((idx % NORMAL_LUT_DIM) + 0.5f) * STEP - 1.0f;
+  float v = ((idx / NORMAL_LUT_DIM) + 0.5f) * STEP - 1.0f;
+  fm_vec3_t norm{u, 1.0f - fabsf(u) - fabsf(v), v};
+  if(norm.y < 0) {
+    norm.x = (1.0f - fabsf(v)) * (u < 0 ? -1.0f : 1.0f);
+    norm.z = (1.0f - fabsf(u)) * (v < 0 ? -1.0f : 1.0f);
+  }
+  return Math::normalizeUnsafe(norm);
+}
+
+// marks all entries as stale, tags are only cleared once the 8-bit epoch wraps around
+inline void invalidateNormalLut()
+{
+  if(++normalLutEpochCurr == 0) {
+    for(auto &epoch : normalLutEpoch)epoch = 0;
+    normalLutEpochCurr = 1;
+  }
+}
+
+/**
+ * Invalidates the LUT if the camera rotated since the last time, must be called after 'setupFrame()'.
+ */
+template<SDFConf CONF>
+void updateNormalLut()
+{
+  const fm_vec3_t &camDir = camera.camDir;
+  if(normalLutFunc == CONF.fnNormalLut && camDir.x == normalLutDir.x && camDir.y == normalLutDir.y && camDir.z == normalLutDir.z) {
+    return;
+  }
+  normalLutDir = camDir;
+  normalLutFunc = CONF.fnNormalLut;
+  invalidateNormalLut();
+}
+
+/**
+ * LUT color for 'norm', the cell is shaded with 'normalLutFunc' if it is stale.
+ */
+inline uint16_t normalLutColor(const fm_vec3_t &norm)
+{
+  int idx = normalLutIndex(norm);
+  if(normalLutEpoch[idx] != normalLutEpochCurr) {
+    normalLutEpoch[idx] = normalLutEpochCurr;
+    normalLut[idx] = normalLutFunc(normalLutCellNormal(idx));
+  }
+  return normalLut[idx];
+}
+
+inline uint16_t envLutColor(const fm_vec3_t &norm) {
+  return envTexColor((const uint8_t*)MemMap::TEX3_CACHED, norm, NORMAL_LUT_MIP);
+}
+
+inline uint16_t env2LutColor(const fm_vec3_t &norm) {
+  return envTexColor((const uint8_t*)MemMap::TEX3_CACHED + Tex::CI8_BYTES, norm, NORMAL_LUT_MIP) & ~1;
+}
+
+// LUT version of 'shadeResultEnv2', for 'shadeResultEnv' see 'shadeEnvLutStages'
+inline uint32_t shadeResultEnv2Lut(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int)
+{
+  if(dist == 0) {
+    return sampleSky(dir);
+  }
+  return normalLutColor(norm);
+}
@@ -0,0 +1,51 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Periodic color functions of the procedural shaders, baked into small LUTs at init.
+// They are indexed by a fixed-point coordinate where SIZE units are one period (2*pi).
+namespace Palette
+{
+  constexpr int SIZE = 256;
+  constexpr float UNITS_PER_RAD = SIZE / (2.0f * 3.14159265f);
+
+  template<typename T>
+  struct LUT {
+    T col[SIZE];
+  };
+
+  template<typename T, typename F>
+  void bake(LUT<T> &lut, F fn) {
+    for(int i=0; i<SIZE; ++i) {
+      lut.col[i] = fn((float)i * (1.0f / UNITS_PER_RAD));
+    }
+  }
+
+  // wraps around in both directions
+  template<typename T>
+  inline const T& get(const LUT<T> &lut, int idx) {
+    return lut.col[idx & (SIZE-1)];
+  }
+}
+
+// phase-shifted sines per channel, in the range [0, 2]
+constinit Palette::LUT<fm_vec3_t> paletteRainbow{};
+// same in 'ColorFP' units (ONE = 1.0)
+constinit Palette::LUT<ColorFP::RGB> paletteRainbowFP{};
+
+inline void bakePalettes()
+{
+  Palette::bake(paletteRainbow, [](float s) {
+    return fm_vec3_t{
+      Math::sinApprox(s + 0.0f) + 1.0f,
+      Math::sinApprox(s + 2.0f) + 1.0f,
+      Math::sinApprox(s + 4.0f) + 1.0f,
+    };
+  });
+  for(int i=0; i<Palette::SIZE; ++i) {
+    const auto &col = paletteRainbow.col[i];
+    paletteRainbowFP.col[i] = ColorFP::fromFP(ColorFP::factor(col.x), ColorFP::factor(col.y), ColorFP::factor(col.z));
+  }
+}
@@ -0,0 +1,156 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#include "present.h"
+
+namespace {
+  constexpr uint32_t MAX_BUFFERS = 3;
+  constexpr uint32_t BUSY = 0xFFFF'FFFF;
+
+  surface_t *buffers{nullptr};
+  constinit uint32_t bufferCount = 0;
+
+  // vblank counter at which a buffer can be drawn into again, 'BUSY' if owned by the VI or the renderer
+  constinit uint32_t freeAt[MAX_BUFFERS]{};
+
+  constinit int shownIdx = -1;
+  constinit int queuedIdx = -1;
+  constinit int drawIdx = -1;
+  constinit uint32_t queuedAt = 0; // vblank count at the time of 'vi_show()'
+  constinit uint32_t lastFlip = 0; // vblank count at which the current buffer appeared
+
+  constinit Present::Pacing pacing = Present::Pacing::NONE;
+  constinit uint32_t missedFrames = 0;
+
+  constinit uint32_t vblankTicks = 0;
+  constinit uint32_t lastVblankTicks = 0;
+  volatile constinit uint32_t vblankCount = 0;
+
+  // the VI interrupt fires a few (half-)lines into the vblank, anything close to it was serviced right away
+  constexpr uint32_t PROMPT_LINES = 8;
+
+  void onVblank()
+  {
+    // The ray-marcher runs with interrupts disabled, so multiple vblanks can collapse into one interrupt.
+    // Recover the real count from the time since the last vblank, stepping that forward in whole periods.
+    // Taking 'now' instead would shift the phase by however late we are, and the next interrupt could come up short.
+    uint32_t now = TICKS_READ();
+    int32_t dist = TICKS_DISTANCE(lastVblankTicks, now);
+    uint32_t passed = dist > 0 ? ((uint32_t)dist / vblankTicks) : 0;
+
+    if(passed == 0) {
+      // the nominal period is only an approximation of the VI timing and drifted, re-sync
+      passed = 1;
+      lastVblankTicks = now;
+    } else {
+      lastVblankTicks += passed * vblankTicks;
+    }
+
+    // not delayed by the ray-marcher: 'now' is the actual vblank, so the phase is exact again
+    uint32_t line = (*VI_V_CURRENT & 0x3FF) - (*VI_V_INTR & 0x3FF);
+    if(line < PROMPT_LINES)lastVblankTicks = now;
+
+    vblankCount = vblankCount + passed;
+  }
+
+  // checks if the queued buffer was picked up by the VI, which frees the one shown before it
+  void update()
+  {
+    uint32_t count = vblankCount;
+    if(queuedIdx < 0 || count == queuedAt)return;
+
+    if(shownIdx >= 0)freeAt[shownIdx] = 0;
+    shownIdx = queuedIdx;
+    queuedIdx = -1;
+    lastFlip = queuedAt + 1;
+  }
+
+  inline uint32_t getInterval() {
+    return (uint32_t)pacing;
+  }
+}
+
+void Present::init(surface_t *fbs, uint32_t count)
+{
+  assert(count <= MAX_BUFFERS);
+  buffers = fbs;
+  bufferCount = count;
+
+  vblankTicks = TICKS_PER_SECOND / (get_tv_type() == TV_TYPE_PAL ? 50 : 60);
+  lastVblankTicks = TICKS_READ();
+  register_VI_handler(onVblank);
+
+  for(uint32_t i=0; i<count; ++i)freeAt[i] = 0;
+  shownIdx = 0;
+  freeAt[0] = BUSY;
+}
+
+surface_t* Present::acquire()
+{
+  if(drawIdx >= 0)return &buffers[drawIdx];
+
+  for(;;) {
+    update();
+    uint32_t count = vblankCount;
+    for(uint32_t i=0; i<bufferCount; ++i) {
+      if(freeAt[i] != BUSY && (int32_t)(count - freeAt[i]) >= 0) {
+        freeAt[i] = BUSY;
+        drawIdx = i;
+        return &buffers[i];
+      }
+    }
+    vi_wait_vblank();
+  }
+}
+
+surface_t* Present::front()
+{
+  update();
+  return &buffers[queuedIdx >= 0 ? queuedIdx : shownIdx];
+}
+
+void Present::submit(surface_t *fb)
+{
+  int idx = fb - buffers;
+  assert(idx == drawIdx);
+  drawIdx = -1;
+  update();
+
+  if(pacing == Pacing::NONE) {
+    // mailbox: replace a frame that did not make it to the screen yet.
+    // it may still get picked up by the next vblank, so keep it for one more frame
+    if(queuedIdx >= 0)freeAt[queuedIdx] = vblankCount + 2;
+  } else {
+    // FIFO: every frame is shown for at least the interval
+    while(queuedIdx >= 0) {
+      vi_wait_vblank();
+      update();
+    }
+
+    // 'vi_show()' is latched at the next vblank, so submit one frame ahead of the target
+    uint32_t target = lastFlip + getInterval() - 1;
+    if((int32_t)(vblankCount - target) > 0)++missedFrames;
+    while((int32_t)(vblankCount - target) < 0)vi_wait_vblank();
+  }
+
+  // make sure no vblank sneaks in between, otherwise we would count the flip one frame too early
+  disable_interrupts();
+    vi_show(fb);
+    queuedIdx = idx;
+    queuedAt = vblankCount;
+  enable_interrupts();
+}
+
+void Present::setPacing(Pacing newPacing) {
+  pacing = newPacing;
+  missedFrames = 0;
+}
+
+Present::Pacing Present::getPacing() {
+  return pacing;
+}
+
+uint32_t Present::getMissedFrames() {
+  return missedFrames;
+}
@@ -0,0 +1,54 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+#include <libdragon.h>
+
+/**
+ * Present queue over a fixed set of framebuffers.
+ * Keeps track of which buffer the VI is scanning out (or will at the next vblank),
+ * so that we never draw into a buffer that is still visible.
+ * Presentation can optionally be locked to a fixed vblank interval.
+ */
+namespace Present
+{
+  enum class Pacing : uint8_t {
+    NONE  = 0, // show at the next vblank, drops older frames if we are faster
+    HZ_60 = 1, // values are the interval in vblanks (NTSC)
+    HZ_30 = 2,
+    HZ_20 = 3,
+  };
+
+  /**
+   * Takes ownership of the buffers, the first one is treated as being on screen.
+   * The caller has to 'vi_show()' it once it has valid contents.
+   */
+  void init(surface_t *buffers, uint32_t count);
+
+  /**
+   * Returns a buffer not owned by the VI, waits for a vblank if none is free.
+   * If the last acquired buffer was never submitted (e.g. after a soft-reset), it is returned again.
+   */
+  surface_t* acquire();
+
+  /**
+   * Returns the buffer that is on screen (or queued to be), used to render with visible progress.
+   */
+  surface_t* front();
+
+  /**
+   * Queues the buffer from 'acquire()' for display.
+   * With pacing enabled, this blocks until the previous frame was shown
+   * and the interval since then has passed.
+   */
+  void submit(surface_t *fb);
+
+  void setPacing(Pacing pacing);
+  Pacing getPacing();
+
+  /**
+   * Number of paced frames that were shown later than their deadline.
+   */
+  uint32_t getMissedFrames();
+}
@@ -0,0 +1,64 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Progressive mode: passes with a block size of 8, 4, 2 and 1 pixels.
+// Each pass only marches pixels not hit by a coarser one and fills its block with them,
+// after the last pass every pixel has been marched exactly once.
+constexpr int PROGRESSIVE_START = 8;
+static_assert(OUTPUT_WIDTH % PROGRESSIVE_START == 0 && OUTPUT_HEIGHT % PROGRESSIVE_START == 0);
+
+template<SDFConf CONF, int SIZE>
+void drawProgressivePass(uint16_t *buff)
+{
+  fm_vec3_t camPos = camera.camPos;
+  constexpr int COLUMNS = OUTPUT_WIDTH / SIZE;
+
+  for(int y=0; y<OUTPUT_HEIGHT; y+=SIZE)
+  {
+    // lines already hit by the coarser pass only have new pixels in the odd columns
+    bool isNewLine = SIZE == PROGRESSIVE_START || (y % (SIZE*2)) != 0;
+    int count = isNewLine ? COLUMNS : (COLUMNS / 2);
+    int xStart = isNewLine ? 0 : SIZE;
+    int xStep = isNewLine ? SIZE : (SIZE*2);
+
+    auto rowDir = rayStepY * (float)y + rayDirOrigin;
+    auto stepDir = rayStepX * (float)xStep;
+    auto startDir = rayStepX * (float)xStart + rowDir;
+    uint16_t *buffRow = buff + y * (FB_STRIDE/2) + xStart;
+
+    marchSamples<CONF>(count,
+      [&](int i) { return startDir + stepDir * (float)i; },
+      [&](int i, float distTotal, const fm_vec3_t &dir, int material) {
+        writeBlock<SIZE>(buffRow + i * xStep, shadeSample<CONF>(distTotal, dir, camPos, material));
+      }
+    );
+  }
+}
+
+/**
+ * Draws all passes, returns false if it stopped before the last one due to the frame-budget.
+ */
+template<SDFConf CONF>
+bool drawProgressive(void* fb)
+{
+  auto buff = (uint16_t*)((char*)fb + (OFFSET_Y * FB_STRIDE) + OFFSET_X*2);
+
+  // the next pass marches 3x the pixels of all passes so far
+  auto fitsBudget = [&]() {
+    if(frameBudget == 0)return true;
+    uint32_t ticksFrame = TICKS_DISTANCE(frameStart, TICKS_READ());
+    return ticksFrame < frameBudget && ticksFrame * 3 <= (frameBudget - ticksFrame);
+  };
+
+  drawProgressivePass<CONF, 8>(buff);
+  if(!fitsBudget())return false;
+  drawProgressivePass<CONF, 4>(buff);
+  if(!fitsBudget())return false;
+  drawProgressivePass<CONF, 2>(buff);
+  if(!fitsBudget())return false;
+  drawProgressivePass<CONF, 1>(buff);
+  return true;
+}
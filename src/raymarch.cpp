@@ -11,6 +11,8 @@ namespace {
 }
 
 #include <libdragon.h>
+#include <algorithm>
+#include <iterator>
 #include "raymarch.h"
 #include "main.h"
 #include "math/mathFloat.h"
@@ -24,30 +26,28 @@ extern "C" {
 namespace
 {
   #include "sdf/sdf.h"
-
-  typedef float (*FuncSDF)(const fm_vec3_t&);
-  typedef fm_vec3_t (*FuncNorm)(const fm_vec3_t&);
-  typedef uint32_t (*FuncShade)(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist);
+  #include "sdfConf.h"
 
   constinit fm_vec3_t lightPos{};
   constinit fm_vec3_t right{};
   constinit fm_vec3_t up{};
 
+  constinit fm_vec3_t rayDirOrigin{};
+  constinit fm_vec3_t rayStepX{};
+  constinit fm_vec3_t rayStepY{};
+
+  constinit uint32_t frameBudget = 0;
+  constinit uint32_t frameStart = 0;
+  constinit int degradedLines = 0;
+  constinit RayMarch::Mode renderMode = RayMarch::Mode::SCALED;
+
+  // size of a pixel at a distance of 1 for the resolution currently drawn, used for mip-mapping
+  constinit float pixelSize = 1.0f / OUTPUT_HEIGHT;
+
   constinit float renderDist = RENDER_DIST;
   constinit float renderDistInv = 1.0f / RENDER_DIST;
   constinit FP32 renderDistFP{RENDER_DIST};
 
-  struct SDFConf
-  {
-    FuncSDF fnSDF;
-    FuncNorm fnNorm;
-    FuncShade fnShade;
-    uint32_t fnUcode;
-    uint32_t bgColor = 0;
-    float renderDist;
-    bool shadeNoHit = false;
-  };
-
   constexpr uint32_t createBgColor(color_t c) {
     return (((int)c.r >> 3) << 11) | (((int)c.g >> 3) << 6) | (((int)c.b >> 3) << 1) | (c.a >> 7);
   }
@@ -59,7 +59,20 @@ namespace
     renderDistFP = FP32{dist};
   }
 
+  #include "colorFP.h"
+  #include "palette.h"
   #include "shading.h"
+  #include "reproject.h"
+  #include "upsample.h"
+  #include "normalLut.h"
+  #include "faceCache.h"
+  #include "lights.h"
+  #include "cellVolume.h"
+  #include "shadeStages.h"
+
+  // samples of the last and current row for the upsampled modes (enough for 1/2 res)
+  constinit uint16_t upsampleColor[2][OUTPUT_WIDTH/2]{};
+  constinit uint16_t upsampleDepth[2][OUTPUT_WIDTH/2]{};
 
   void loadTexture(const char* path, uint32_t addr, int size = TEXTURE_BYTES) {
     auto f = asset_fopen(path, &size);
@@ -67,17 +80,12 @@ namespace
     fclose(f);
   }
 
-  // We use templates here to intentionally dupe the code.
-  // This means things like different SDFs and scaling can be "hardcoded" by the compiler.
-  // Since we stay in only one function the entire frame, this saves time since it avoids if-checks.
-  template<SDFConf CONF, int SCALING>
-  void drawGeneric(void* fb, float time)
+  // Frame setup shared by all passes, the ray of any output pixel (x,y) is:
+  // rayDirOrigin + (rayStepX * x) + (rayStepY * y)
+  template<SDFConf CONF>
+  void setupFrame()
   {
-    constexpr int W = OUTPUT_WIDTH / SCALING;
-    constexpr int H = OUTPUT_HEIGHT / SCALING;
-    constexpr float invH = 1.0f / (float)H;
-
-    auto buff = (char*)fb;
+    constexpr float invH = 1.0f / (float)OUTPUT_HEIGHT;
 
     fm_vec3_t camPos = camera.camPos;
     fm_vec3_t camDir = camera.camDir;
@@ -91,23 +99,244 @@ namespace
     constexpr fm_vec3_t worldUp{0,1,0};
     right = Math::normalizeUnsafe(Math::cross(camDir, worldUp));
     up = Math::cross(right, camDir);
-    auto rightStep = right * invH;
-    assert(rightStep.y == 0);
+
+    constexpr float stepX = (-OUTPUT_WIDTH/2) * invH;
+    constexpr float stepY = (-OUTPUT_HEIGHT/2) * invH;
+
+    rayStepX = right * invH;
+    rayStepY = up * invH;
+    rayDirOrigin = up * stepY + (camDir + right * stepX);
+    assert(rayStepX.y == 0);
+
+    UCode::sync();
+  }
+
+  // Writes a color as a SCALING x SCALING block, 'lineCount' allows clipping the last row
+  template<int SCALING>
+  inline void writeBlock(uint16_t *buff, uint16_t color, [[maybe_unused]] int lineCount = SCALING)
+  {
+    constexpr auto xy = [](int x, int y){ return y*FB_STRIDE/2 + x; };
+    if constexpr (SCALING == 1) {
+      buff[0] = color;
+    } else if constexpr (SCALING == 2) {
+      // blocks are aligned to their size, so rows can be written with one store
+      uint32_t color2 = color * 0x0001'0001;
+      *(uint32_t*)&buff[xy(0,0)] = color2;
+      *(uint32_t*)&buff[xy(0,1)] = color2;
+    } else if constexpr (SCALING == 3) {
+      for (int y=0; y<lineCount; ++y) {
+        buff[xy(0,y)] = color;
+        buff[xy(1,y)] = color;
+        buff[xy(2,y)] = color;
+      }
+    } else if constexpr (SCALING % 4 == 0) {
+      uint64_t color4 = Color4::splat(color);
+      for (int y=0; y<SCALING; ++y) {
+        for (int x=0; x<SCALING; x+=4)*(uint64_t*)&buff[xy(x,y)] = color4;
+      }
+    } else {
+      for (int y=0; y<SCALING; ++y) {
+        for (int x=0; x<SCALING; ++x)buff[xy(x,y)] = color;
+      }
+    }
+  }
+
+  /**
+   * Projects the time of the remaining work based on the average of what was done since 'ticksStart'.
+   * Returns true if that would not fit into the frame-budget anymore, which must be set.
+   */
+  inline bool isOverBudget(uint32_t ticksStart, int done, int remaining)
+  {
+    uint32_t now = TICKS_READ();
+    uint32_t ticksFrame = TICKS_DISTANCE(frameStart, now);
+    uint32_t ticksDone = TICKS_DISTANCE(ticksStart, now);
+    return ticksFrame >= frameBudget || ticksDone * remaining > (frameBudget - ticksFrame) * done;
+  }
+
+  // primitive the RSP hit for ray 'idx' of the last pair, see 'SDFConf::materials'
+  template<SDFConf CONF>
+  inline int readMaterial(int idx)
+  {
+    if constexpr (CONF.materials)return UCode::getMaterial(idx);
+    return 0;
+  }
+
+  template<SDFConf CONF>
+  inline uint32_t shadeSample(float distTotal, const fm_vec3_t &dir, const fm_vec3_t &camPos, int material)
+  {
+    if(distTotal >= renderDist) {
+      if constexpr (CONF.shadeNoHit) {
+        return CONF.fnShade({0,0,0}, {0,0,0}, dir, 0, 0);
+      }
+      return CONF.bgColor;
+    }
+    auto hitPos = camPos + (dir * distTotal);
+    if constexpr (CONF.faces != nullptr) {
+      int face = CONF.faces->fnFace(hitPos);
+      return CONF.faces->fnShade(face, CONF.faces->normals[face], hitPos, dir, distTotal);
+    }
+    auto norm = CONF.fnNorm(hitPos);
+    return CONF.fnShade(norm, hitPos, dir, distTotal, material);
+  }
+
+  /**
+   * Marches an arbitrary list of rays, two at a time while the CPU shades the last two.
+   * 'fnDir(i)' returns the unnormalized ray of sample 'i', 'fnOut(i, distTotal, dir, material)' gets its result.
+   */
+  template<SDFConf CONF, typename FnDir, typename FnOut>
+  void marchSamples(int count, FnDir fnDir, FnOut fnOut)
+  {
+    if(count <= 0)return;
+
+    fm_vec3_t dir0, dir1;
+    FP32Vec3 dirFp0, dirFp1;
+    int next = 0;
+
+    auto advanceDir = [&]() {
+      dir0 = Math::normalizeUnsafe(fnDir(next));
+      // odd counts march the last ray twice
+      dir1 = Math::normalizeUnsafe(fnDir(next+1 < count ? next+1 : next));
+      next += 2;
+      dirFp0 = {FP32::half(dir0.x), FP32::half(dir0.y), FP32::half(dir0.z)};
+      dirFp1 = {FP32::half(dir1.x), FP32::half(dir1.y), FP32::half(dir1.z)};
+      dirFp0.x.val = (dirFp0.x.val << 16) | (dirFp0.y.val & 0xFFFF);
+      dirFp1.x.val = (dirFp1.x.val << 16) | (dirFp1.y.val & 0xFFFF);
+    };
+
+    auto startNextUcode = [&] {
+      UCode::setRayDirections(dirFp0, dirFp1);
+      UCode::run(CONF.fnUcode);
+    };
+
+    advanceDir();
+
+    MEMORY_BARRIER();
+    startNextUcode(); // same workaround as in 'drawGeneric()'
+    UCode::stop();
+    startNextUcode();
+    MEMORY_BARRIER();
+
+    for(int i=0; i<count; i+=2)
+    {
+      fm_vec3_t dirA = dir0;
+      fm_vec3_t dirB = dir1;
+      bool hasNext = next < count;
+      if(hasNext)advanceDir();
+
+      UCode::sync();
+      auto distTotalA = UCode::getTotalDist(0);
+      auto distTotalB = UCode::getTotalDist(1);
+      int materialA = readMaterial<CONF>(0);
+      int materialB = readMaterial<CONF>(1);
+
+      if(hasNext)startNextUcode();
+      MEMORY_BARRIER();
+
+      fnOut(i, distTotalA.toFloat(), dirA, materialA);
+      if(i+1 < count)fnOut(i+1, distTotalB.toFloat(), dirB, materialB);
+    }
+    UCode::stop();
+  }
+
+  // We use templates here to intentionally dupe the code.
+  // This means things like different SDFs and scaling can be "hardcoded" by the compiler.
+  // Since we stay in only one function the entire frame, this saves time since it avoids if-checks.
+  // Draws output lines starting at 'line' and returns the line it stopped at.
+  // With a frame-budget set, this stops early if the remaining lines are projected to miss it.
+  // In checkerboard mode only every other pixel is marched (alternating each line and frame),
+  // the skipped ones of the last line are reconstructed while the RSP works on the current one.
+  // At 1/2 and 1/4 res, blocks are upsampled between the samples of the last and current line instead of replicated.
+  template<SDFConf CONF, int SCALING, bool CHECKER = false>
+  int drawGeneric(void* fb, int line)
+  {
+    static_assert(!CHECKER || SCALING == 1);
+
+    // next coarser mode to fall back to, we can only switch on lines aligned to it
+    constexpr int NEXT_SCALING = SCALING + 1;
+    constexpr bool CAN_DEGRADE = SCALING < 4;
+    // 1/3 doesn't divide the height evenly, so the last row needs to be clipped
+    constexpr bool CLIP_LAST = (OUTPUT_HEIGHT % SCALING) != 0;
+    // horizontal distance between two marched pixels
+    constexpr int STEP_X = CHECKER ? 2 : SCALING;
+    pixelSize = SCALING * (1.0f / OUTPUT_HEIGHT);
+    constexpr bool UPSAMPLE = SCALING == 2 || SCALING == 4;
+    constexpr int SAMPLES_X = OUTPUT_WIDTH / SCALING;
+
+    auto buff = (char*)fb;
+    fm_vec3_t camPos = camera.camPos;
+    fm_vec3_t camDir = camera.camDir;
+
+    auto rightStep = rayStepX * STEP_X;
+    auto upStep = rayStepY * SCALING;
+
+    // checkerboard/upsampling: the last line that still has pixels to be reconstructed
+    uint16_t *lastRowBuff{nullptr};
+    uint16_t *lastRowDepth{nullptr};
+    fm_vec3_t lastRowDir{};
+    int lastRowParity = 0;
+
+    auto reconstruct = [&](int x) {
+      auto rayDir = lastRowDir + rayStepX * (float)x;
+      lastRowBuff[x] = reconstructPixel<CONF>(lastRowBuff, lastRowDepth, x, rayDir);
+    };
+
+    // upsampling: blocks of the last line need the samples of the current one below them
+    uint16_t *upColorLast = upsampleColor[0];
+    uint16_t *upDepthLast = upsampleDepth[0];
+    uint16_t *upColor = upsampleColor[1];
+    uint16_t *upDepth = upsampleDepth[1];
+
+    auto upsample = [&](int i) {
+      if constexpr (UPSAMPLE) {
+        int i1 = i+1 < SAMPLES_X ? i+1 : i;
+        const uint16_t c[4]{upColorLast[i], upColorLast[i1], upColor[i], upColor[i1]};
+        const uint16_t z[4]{upDepthLast[i], upDepthLast[i1], upDepth[i], upDepth[i1]};
+        upsampleBlock<SCALING>(lastRowBuff + i*SCALING, c, z);
+      }
+    };
+
+    auto reconstructLastRow = [&]() {
+      if(!lastRowBuff)return;
+      if constexpr (CHECKER) {
+        // fill the pixels that were skipped, not the ones marched in that line
+        for(int x=lastRowParity^1; x<OUTPUT_WIDTH; x+=2)reconstruct(x);
+      }
+      if constexpr (UPSAMPLE) {
+        // nothing below the last line, so only interpolate horizontally
+        upColor = upColorLast;
+        upDepth = upDepthLast;
+        for(int i=0; i<SAMPLES_X; ++i)upsample(i);
+      }
+    };
 
     buff += (OFFSET_Y * FB_STRIDE) + OFFSET_X*2;
+    buff += line * FB_STRIDE;
     constexpr int stride = FB_STRIDE * SCALING;
 
-    constexpr float stepX = (-W/2) * invH;
-    constexpr float stepY = (-H/2) * invH;
-    camDir += right * stepX;
+    fm_vec3_t rayDirY = rayStepY * (float)line + rayDirOrigin;
 
-    fm_vec3_t rayDirY = up * stepY + camDir;
+    uint32_t ticksScaleStart = TICKS_READ();
+    int lineScaleStart = line;
 
-    UCode::sync();
-
-    for(int y=0; y!=H; ++y)
+    for(; line < OUTPUT_HEIGHT; line += SCALING)
     {
+        if constexpr (CAN_DEGRADE) {
+          if(frameBudget != 0 && line != lineScaleStart && (line % NEXT_SCALING) == 0) {
+            if(isOverBudget(ticksScaleStart, line - lineScaleStart, OUTPUT_HEIGHT - line)) {
+              reconstructLastRow();
+              return line;
+            }
+          }
+        }
+
+        // skipped pixels of the last line are at the same X positions we march in this one
+        int parity = CHECKER ? ((line + checkerFrame) & 1) : 0;
+        auto rowDir = rayDirY;
         auto rayDirXY = rayDirY;
+        if constexpr (CHECKER) {
+          rayDirXY.x += rayStepX.x * parity;
+          rayDirXY.z += rayStepX.z * parity;
+        }
 
         fm_vec3_t dir0, dir1;
         FP32Vec3 dirFp0, dirFp1;
@@ -140,31 +369,22 @@ namespace
         startNextUcode();
         MEMORY_BARRIER();
 
-        rayDirY += (up * invH);
-        uint16_t *buffLocal = (uint16_t*)buff;
+        rayDirY += upStep;
+        uint16_t *buffRow = (uint16_t*)buff;
+        uint16_t *buffLocal = buffRow + parity;
         const uint16_t *buffLocalEnd = buffLocal + OUTPUT_WIDTH;
+        uint16_t *depthRow = CHECKER ? (depthCurr + line * OUTPUT_WIDTH) : nullptr;
+        uint16_t *depthLocal = CHECKER ? (depthRow + parity) : nullptr;
+        int lineCount = CLIP_LAST ? std::min(SCALING, OUTPUT_HEIGHT - line) : SCALING;
 
         advanceDir();
 
+        uint32_t pairLast = 0;
+
         auto writeColor = [&](uint16_t color)
         {
-          constexpr auto xy = [](int x, int y){ return y*FB_STRIDE/2 + x; };
-          if constexpr (SCALING == 1) {
-            buffLocal[0] = color;
-          } else if constexpr (SCALING == 2) {
-            buffLocal[xy(0,0)] = color;
-            buffLocal[xy(1,0)] = color;
-            buffLocal[xy(0,1)] = color;
-            buffLocal[xy(1,1)] = color;
-          } else if constexpr (SCALING == 4) {
-            for (int y=0; y<4; ++y) {
-              buffLocal[xy(0,y)] = color;
-              buffLocal[xy(1,y)] = color;
-              buffLocal[xy(2,y)] = color;
-              buffLocal[xy(3,y)] = color;
-            }
-          }
-          buffLocal += SCALING;
+          writeBlock<SCALING>(buffLocal, color, lineCount);
+          buffLocal += STEP_X;
         };
 
         do
@@ -174,46 +394,137 @@ namespace
           // This can be done by e.g. using the DP_END register as a general purpose reg with 24bits.
           auto distTotalA = UCode::getTotalDist(0);
           auto distTotalB = UCode::getTotalDist(1);
+          int materialA = readMaterial<CONF>(0);
+          int materialB = readMaterial<CONF>(1);
 
           startNextUcode();
           MEMORY_BARRIER();
 
-          //uint32_t col = 0;
-          auto applyShade = [&](float distTotal, const fm_vec3_t &oldDir) {
-            if(distTotal >= renderDist) {
-              if constexpr (CONF.shadeNoHit) {
-                return CONF.fnShade({0,0,0}, {0,0,0}, oldDir, 0);
-              }
-              return CONF.bgColor;
-            }
-            auto hitPos = camPos + (oldDir * distTotal);
-            auto norm = CONF.fnNorm(hitPos);
-            return CONF.fnShade(norm, hitPos, oldDir, distTotal);
+          auto applyShade = [&](float distTotal, const fm_vec3_t &oldDir, int material) {
+            return shadeSample<CONF>(distTotal, oldDir, camPos, material);
           };
 
-          writeColor(applyShade(distTotalA.toFloat(), dir0));
-          writeColor(applyShade(distTotalB.toFloat(), dir1));
+          if constexpr (UPSAMPLE) {
+            int i = (buffLocal - buffRow) / SCALING;
+            upColor[i]   = applyShade(distTotalA.toFloat(), dir0, materialA);
+            upColor[i+1] = applyShade(distTotalB.toFloat(), dir1, materialB);
+            upDepth[i]   = toDepth(distTotalA.toFloat(), dir0, camDir);
+            upDepth[i+1] = toDepth(distTotalB.toFloat(), dir1, camDir);
+            buffLocal += STEP_X * 2;
+
+            if(lastRowBuff) {
+              if(i > 0)upsample(i-1);
+              upsample(i);
+            }
+          } else if constexpr (CHECKER) {
+            int x = buffLocal - buffRow;
+            depthLocal[0] = toDepth(distTotalA.toFloat(), dir0, camDir);
+            depthLocal[2] = toDepth(distTotalB.toFloat(), dir1, camDir);
+            depthLocal += 4;
+
+            writeColor(applyShade(distTotalA.toFloat(), dir0, materialA));
+            writeColor(applyShade(distTotalB.toFloat(), dir1, materialB));
+
+            if(lastRowBuff) {
+              reconstruct(x);
+              reconstruct(x + 2);
+            }
+          } else if constexpr (SCALING == 1) {
+            // neighbouring pixels, every other pair completes 4 of them for one 64-bit store
+            uint32_t pair = ((applyShade(distTotalA.toFloat(), dir0, materialA) & 0xFFFF) << 16)
+                          | (applyShade(distTotalB.toFloat(), dir1, materialB) & 0xFFFF);
+            if((buffLocal - buffRow) & 2) {
+              *(uint64_t*)(buffLocal - 2) = ((uint64_t)pairLast << 32) | pair;
+            }
+            pairLast = pair;
+            buffLocal += 2;
+          } else {
+            writeColor(applyShade(distTotalA.toFloat(), dir0, materialA));
+            writeColor(applyShade(distTotalB.toFloat(), dir1, materialB));
+          }
 
           advanceDir();
 
         } while(buffLocal != buffLocalEnd);
 
+        if constexpr (UPSAMPLE) {
+          if(lastRowBuff)upsample(SAMPLES_X-1);
+          lastRowBuff = buffRow;
+          std::swap(upColor, upColorLast);
+          std::swap(upDepth, upDepthLast);
+        }
+
+        if constexpr (CHECKER) {
+          lastRowBuff = buffRow;
+          lastRowDepth = depthRow;
+          lastRowDir = rowDir;
+          lastRowParity = parity;
+        }
+
         buff += stride;
         UCode::stop();
     }
+    reconstructLastRow();
+    return line;
   }
 
+  #include "adaptive.h"
+  #include "progressive.h"
+  #include "screenNormals.h"
+  #include "tiledLights.h"
+
   template<SDFConf CONF>
   inline void drawGenericRes(void* fb, float time, int resFactor)
   {
     setRenderDist(CONF.renderDist);
+    setupFrame<CONF>();
+    if constexpr (CONF.fnNormalLut != nullptr)updateNormalLut<CONF>();
+    if constexpr (CONF.faces != nullptr)updateFaceCache<CONF>();
+    if constexpr (CONF.tiledLights)updateLightGrid();
+
+    // the remaining modes all end up with a full-res image
+    pixelSize = 1.0f / OUTPUT_HEIGHT;
+    if(renderMode == RayMarch::Mode::ADAPTIVE && resFactor == 1) {
+      degradedLines = OUTPUT_HEIGHT - drawAdaptive<CONF>(fb);
+      return;
+    }
+    if(renderMode == RayMarch::Mode::PROGRESSIVE && resFactor == 1) {
+      degradedLines = drawProgressive<CONF>(fb) ? 0 : OUTPUT_HEIGHT;
+      return;
+    }
+    // each mode falls through to the next coarser one if it ran out of time
+    int line = 0;
+    int lineDegraded = OUTPUT_HEIGHT;
+    auto checkDegraded = [&](int scaling) {
+      if(scaling == resFactor)lineDegraded = line;
+    };
+
     switch (resFactor) {
       default:
-      case 1: drawGeneric<CONF, 1>(fb, time); break;
-      case 2: drawGeneric<CONF, 2>(fb, time); break;
-      case 4: drawGeneric<CONF, 4>(fb, time); break;
+      case 1:
+        if(renderMode == RayMarch::Mode::CHECKERBOARD) {
+          line = drawGeneric<CONF, 1, true>(fb, line);
+        } else if constexpr (CONF.screenNormals) {
+          line = drawScreenNormals<CONF>(fb);
+        } else if constexpr (CONF.tiledLights) {
+          line = drawTiledLights<CONF>(fb);
+        } else {
+          line = drawGeneric<CONF, 1>(fb, line);
+        }
+        checkDegraded(1);
+        [[fallthrough]];
+      case 2:
+        line = drawGeneric<CONF, 2>(fb, line);
+        checkDegraded(2);
+        [[fallthrough]];
+      case 3:
+        line = drawGeneric<CONF, 3>(fb, line);
+        checkDegraded(3);
+        [[fallthrough]];
+      case 4:
+        drawGeneric<CONF, 4>(fb, line);
     }
-
+    degradedLines = OUTPUT_HEIGHT - lineDegraded;
   }
 
   constexpr SDFConf SDF_MAIN = {
@@ -227,33 +538,43 @@ namespace
   constexpr SDFConf SDF_SPHERE = {
     .fnSDF = SDF::sphere,
     .fnNorm = SDF::sphereNormals,
-    .fnShade = shadeResultPointLight,
+    .fnShade = shadeTileLightsStages,
     .fnUcode = RSP_RAY_CODE_RayMarch_Sphere,
     .renderDist = 11.0f,
+    .tiledLights = true,
   };
 
   constexpr SDFConf SDF_CYLINDER = {
     .fnSDF = SDF::cylinder,
     .fnNorm = SDF::cylinderNormals,
-    .fnShade = shadeResultCylinder,
+    .fnShade = shadeCylinderStages,
     .fnUcode = RSP_RAY_CODE_RayMarch_Cylinder,
     .bgColor = createBgColor({0xFF,0xAA,0xFF}),
     .renderDist = 11.0f,
   };
 
+  constexpr FaceSet OCTA_FACES = {
+    .fnFace = SDF::octaFace,
+    .normals = SDF::OCTA_FACE_NORMALS,
+    .count = std::size(SDF::OCTA_FACE_NORMALS),
+    .fnLight = Stage::Lambert<0.25f>::light,
+    .fnShade = shadeFlatFaceStages,
+  };
+
   constexpr SDFConf SDF_OCTA = {
     .fnSDF = SDF::octa,
     .fnNorm = SDF::octaNormals,
-    .fnShade = shadeResultFlat,
+    .fnShade = shadeFlatStages,
     .fnUcode = RSP_RAY_CODE_RayMarch_Octa,
     .bgColor = createBgColor({0xFF,0x55,0x55}),
     .renderDist = 11.0f,
+    .faces = &OCTA_FACES,
   };
 
   constexpr SDFConf SDF_TEX = {
     .fnSDF = SDF::cylinder,
     .fnNorm = SDF::cylinderNormals,
-    .fnShade = shadeResultTex,
+    .fnShade = shadeTexStages,
     .fnUcode = RSP_RAY_CODE_RayMarch_Cylinder,
     .renderDist = 8.0f,
   };
@@ -261,19 +582,21 @@ namespace
   constexpr SDFConf SDF_ENVMAP = {
     .fnSDF = SDF::main,
     .fnNorm = SDF::mainNormals,
-    .fnShade = shadeResultEnv,
+    .fnShade = shadeEnvLutStages,
     .fnUcode = RSP_RAY_CODE_RayMarch_Main,
     .bgColor = createBgColor({0xEE,0xEE,0xFF}),
     .renderDist = 5.0f,
+    .fnNormalLut = envLutColor,
   };
 
   constexpr SDFConf SDF_ENVMAP_2 = {
     .fnSDF = SDF::main,
     .fnNorm = SDF::mainNormals,
-    .fnShade = shadeResultEnv2,
+    .fnShade = shadeResultEnv2Lut,
     .fnUcode = RSP_RAY_CODE_RayMarch_Main,
     .renderDist = 5.0f,
-    .shadeNoHit = true
+    .shadeNoHit = true,
+    .fnNormalLut = env2LutColor,
   };
 
   constexpr SDFConf SDF_ENVMAP_3 = {
@@ -288,97 +611,269 @@ namespace
   constexpr SDFConf SDF_SPHERE_INF = {
     .fnSDF = SDF::sphere,
     .fnNorm = SDF::sphereNormals,
-    .fnShade = shadeResultCylinder,
+    .fnShade = shadeCylinderStages,
     .fnUcode = RSP_RAY_CODE_RayMarch_Sphere,
     .bgColor = createBgColor({0xFF,0xAA,0xFF}),
     .renderDist = 64.0f,
     .shadeNoHit = false
   };
 
+  // sub-pixel offsets for accumulated frames (halton 2,3)
+  constexpr float JITTER[][2] = {
+    { 0.0f,    -0.1667f}, {-0.25f,   0.1667f}, { 0.25f,  -0.3889f}, {-0.375f, -0.0556f},
+    { 0.125f,   0.2778f}, {-0.125f, -0.2778f}, { 0.375f,  0.0556f}, {-0.4375f, 0.3889f},
+  };
+
+  // everything a frame depends on, if this did not change the last frame can be kept
+  struct FrameState {
+    fm_vec3_t camPos;
+    fm_vec3_t camDir;
+    fm_vec3_t lightPos;
+    float lerpFactor;
+    int sdfIdx;
+    int resFactor;
+    RayMarch::Mode mode;
+
+    bool operator==(const FrameState &o) const {
+      return camPos.x == o.camPos.x && camPos.y == o.camPos.y && camPos.z == o.camPos.z
+        && camDir.x == o.camDir.x && camDir.y == o.camDir.y && camDir.z == o.camDir.z
+        && lightPos.x == o.lightPos.x && lightPos.y == o.lightPos.y && lightPos.z == o.lightPos.z
+        && lerpFactor == o.lerpFactor && sdfIdx == o.sdfIdx && resFactor == o.resFactor && mode == o.mode;
+    }
+  };
+
+  constinit FrameState lastFrame{};
+  constinit bool lastFrameValid = false;
+  constinit int accumFrames = 0;
+  constinit int accumLine = 0; // next row of the pass in progress
+  // new row of the jittered frame, blended into the framebuffer 4 pixels at a time
+  alignas(8) constinit uint16_t accumRow[OUTPUT_WIDTH]{};
+  static_assert(OUTPUT_WIDTH % 4 == 0 && (OFFSET_X * 2) % 8 == 0);
+
+  FrameState getFrameState(int sdfIdx, int resFactor) {
+    return {camera.camPos, camera.camDir, lightPos, lerpFactor, sdfIdx, resFactor, renderMode};
+  }
+
+  // sets the time-driven parameters of a scene
+  // the original light in the center, with smaller colored ones circling around it
+  void updateLights(float time)
+  {
+    constexpr fm_vec3_t COLORS[]{
+      {1.0f, 0.3f, 0.2f}, {0.2f, 1.0f, 0.3f}, {0.3f, 0.4f, 1.0f}, {1.0f, 0.9f, 0.2f},
+      {1.0f, 0.3f, 1.0f}, {0.2f, 1.0f, 1.0f}, {1.0f, 0.6f, 0.2f},
+    };
+    constexpr int COUNT = std::size(COLORS) + 1;
+    static_assert(COUNT <= MAX_LIGHTS);
+
+    lights[0] = {lightPos, {1.0f, 1.0f, 1.0f}, 5.0f};
+    for(int i=1; i<COUNT; ++i) {
+      float angle = time * 0.7f + i * (2.0f * 3.14159265f / (COUNT-1));
+      lights[i] = {
+        {fm_cosf(angle) * 2.5f, fm_sinf(time * 1.3f + i) * 0.75f + 0.5f, fm_sinf(angle) * 2.5f},
+        COLORS[i-1], 1.5f
+      };
+    }
+    setLightCount(COUNT);
+  }
+
+  void updateScene(float time, int sdfIdx)
+  {
+    switch(sdfIdx)
+    {
+      case 0: lerpFactor = fm_sinf(time*4.0f) * 0.5f + 0.5f; break;
+
+      case 1:
+        //lerpFactor = fm_sinf(time*1.0f) * 0.125f + 0.125f;
+        lerpFactor = 0.275f;
+        lightPos = {
+          fm_sinf(time*1.7f) * 0.5f,
+          fm_cosf(time*1.5f) * 0.5f + 0.5f,
+          fm_sinf(time*1.3f + 3.14f) * 0.5f
+        };
+        //lightPos *= 4.0f;
+        updateLights(time);
+        break;
+
+      case 2: lerpFactor = fm_sinf(time*3.0f) * 0.1f + 0.15f; break;
+
+      case 3:
+        lerpFactor = 0.3f;
+        lightPos = {
+          fm_sinf(time*1.3f),
+          0.5f,
+          fm_cosf(time*1.3f),
+        };
+        lightPos = Math::normalize(lightPos);
+        break;
+
+      case 4: lerpFactor = (fm_sinf(time*3.0f) * 0.22f + 0.22f) + 0.05f; break;
+      case 5: lerpFactor = fm_sinf(time*4.0f) * 0.5f + 0.5f; break;
+      case 6: lerpFactor = fm_sinf(time*3.0f) * 0.5f + 0.5f; break;
+      case 7: lerpFactor = fm_sinf(time*2.0f) * 0.5f + 0.5f; break;
+      case 8: lerpFactor = fm_sinf(time*4.0f) * 0.125f + 0.25f; break;
+    }
+  }
+
+  // once every jitter offset was blended in, more frames would only repeat them
+  constexpr int ACCUM_MAX_FRAMES = std::size(JITTER);
+
+  /**
+   * Marches the full frame again with a sub-pixel offset and blends it into the existing one.
+   * The n-th frame gets a weight of 1/(n+1) (in 1/16 steps), so the result is the average of all samples.
+   * Accumulation stops after 'ACCUM_MAX_FRAMES', with 5 bits per channel smaller weights
+   * could no longer move the average without drifting towards one side.
+   * With a frame-budget set, a pass stops at the first row projected to exceed it,
+   * the next call continues there with the same offset and weight.
+   */
+  template<SDFConf CONF>
+  void accumulateFrame(void* fb)
+  {
+    setRenderDist(CONF.renderDist);
+    setupFrame<CONF>();
+    if constexpr (CONF.fnNormalLut != nullptr)updateNormalLut<CONF>();
+    if constexpr (CONF.faces != nullptr)updateFaceCache<CONF>();
+    if constexpr (CONF.tiledLights)updateLightGrid();
+
+    pixelSize = 1.0f / OUTPUT_HEIGHT;
+    const auto &jitter = JITTER[accumFrames % std::size(JITTER)];
+    rayDirOrigin += rayStepX * jitter[0] + rayStepY * jitter[1];
+
+    // 'accumFrames' only counts finished passes, this is frame n+1
+    uint32_t weight = (16 + (accumFrames + 2) / 2) / (accumFrames + 2);
+    fm_vec3_t camPos = camera.camPos;
 
+    uint32_t ticksStart = TICKS_READ();
+    int lineStart = accumLine;
+    auto buff = (char*)fb + ((OFFSET_Y + accumLine) * FB_STRIDE);
+    for(; accumLine<OUTPUT_HEIGHT; ++accumLine)
+    {
+      if(frameBudget != 0 && accumLine != lineStart) {
+        if(isOverBudget(ticksStart, accumLine - lineStart, OUTPUT_HEIGHT - accumLine))return;
+      }
+
+      int y = accumLine;
+      // the framebuffer is uncached, read the old row through the cached alias instead
+      auto rowCached = (char*)CachedAddr(buff);
+      data_cache_hit_invalidate(rowCached, FB_STRIDE);
+      auto colorOld = (const uint64_t*)((const uint16_t*)rowCached + OFFSET_X);
+      auto colorNew = (uint64_t*)((uint16_t*)buff + OFFSET_X);
+      auto colorRow = (const uint64_t*)accumRow;
+
+      auto rowDir = rayStepY * (float)y + rayDirOrigin;
+      marchSamples<CONF>(OUTPUT_WIDTH,
+        [&](int x) { return rowDir + rayStepX * (float)x; },
+        [&](int x, float distTotal, const fm_vec3_t &dir, int material) {
+          accumRow[x] = shadeSample<CONF>(distTotal, dir, camPos, material);
+        }
+      );
+
+      for(int x=0; x<OUTPUT_WIDTH/4; ++x) {
+        colorNew[x] = Color4::mix(colorOld[x], colorRow[x], weight);
+      }
+      buff += FB_STRIDE;
+    }
+    accumLine = 0;
+    ++accumFrames;
+  }
 }
 
 void RayMarch::init() {
   rsp_load(&rsp_raymarch);
   UCode::sync();
 
-  loadTexture("rom:/sky.tex", MemMap::TEX_SKY, 1024*512*2);
+  loadTexture("rom:/sky.tex", MemMap::TEX_SKY, SKY_BYTES);
   loadTexture("rom:/stone.tex", MemMap::TEX0);
   loadTexture("rom:/tiles.tex", MemMap::TEX1);
   loadTexture("rom:/space.tex", MemMap::TEX2);
-  loadTexture("rom:/metal.tex", MemMap::TEX3);
-
-  // generate normal lookup table, this will give the Z component
-  // based on a given X and Y component
-  for(uint8_t y=0; y<=254; ++y) {
-    float fy = (int8_t)y / 127.0f;
-    for(uint8_t x=0; x<=254; ++x) {
-      float fx = (int8_t)x / 127.0f;
-      float fz = 1.0f - fx*fx - fy*fy;
-      if(fz <= 0) {
-        normalZLookup[y][x] = 0;
-      } else {
-        fz = sqrtf(fz);
-        normalZLookup[y][x] = (int8_t)(fz * 127.0f);
-      }
-    }
-  }
+  loadTexture("rom:/metal.tex", MemMap::TEX3, Tex::CI8_BYTES * 2);
+
+  bakePalettes();
+
+  bakeCellAO(SDF_SPHERE.fnSDF, SDF_SPHERE.fnNorm);
+
+  depthCurr = (uint16_t*)MemMap::DEPTH0_CACHED;
+  depthPrev = (uint16_t*)MemMap::DEPTH1_CACHED;
 
 }
 
-void RayMarch::draw(void* fb, float time, int sdfIdx, int resFactor)
+void RayMarch::setMode(Mode mode) {
+  renderMode = mode;
+}
+
+void RayMarch::setFrameBudget(uint32_t ticks) {
+  frameBudget = ticks;
+}
+
+int RayMarch::getDegradedLines() {
+  return degradedLines;
+}
+
+bool RayMarch::isStatic(float time, int sdfIdx, int resFactor)
+{
+  updateScene(time, sdfIdx);
+  return lastFrameValid && getFrameState(sdfIdx, resFactor) == lastFrame;
+}
+
+void RayMarch::accumulate(void* fb, int sdfIdx)
 {
+  if(accumFrames >= ACCUM_MAX_FRAMES)return;
+  frameStart = TICKS_READ();
+
   switch(sdfIdx)
   {
-    case 0:
-      lerpFactor = fm_sinf(time*4.0f) * 0.5f + 0.5f;
-      return drawGenericRes<SDF_MAIN>(fb, time, resFactor);
-
-    case 1:
-      //lerpFactor = fm_sinf(time*1.0f) * 0.125f + 0.125f;
-      lerpFactor = 0.275f;
-      lightPos = {
-        fm_sinf(time*1.7f) * 0.5f,
-        fm_cosf(time*1.5f) * 0.5f + 0.5f,
-        fm_sinf(time*1.3f + 3.14f) * 0.5f
-      };
-      //lightPos *= 4.0f;
-      return drawGenericRes<SDF_SPHERE>(fb, time, resFactor);
-
-    case 2:
-      lerpFactor = fm_sinf(time*3.0f) * 0.1f + 0.15f;
-      return drawGenericRes<SDF_CYLINDER>(fb, time, resFactor);
-
-    case 3: {
-      lerpFactor = 0.3f;
-      lightPos = {
-        fm_sinf(time*1.3f),
-        0.5f,
-        fm_cosf(time*1.3f),
-      };
-      lightPos = Math::normalize(lightPos);
-      return drawGenericRes<SDF_TEX>(fb, time, resFactor);
-    }
+    case 0: accumulateFrame<SDF_MAIN>(fb); break;
+    case 1: accumulateFrame<SDF_SPHERE>(fb); break;
+    case 2: accumulateFrame<SDF_CYLINDER>(fb); break;
+    case 3: accumulateFrame<SDF_TEX>(fb); break;
+    case 4: accumulateFrame<SDF_OCTA>(fb); break;
+    case 5: accumulateFrame<SDF_ENVMAP>(fb); break;
+    case 6: accumulateFrame<SDF_ENVMAP_2>(fb); break;
+    case 7: accumulateFrame<SDF_ENVMAP_3>(fb); break;
+    case 8: accumulateFrame<SDF_SPHERE_INF>(fb); break;
+  }
+}
 
-    case 4:
-      lerpFactor = (fm_sinf(time*3.0f) * 0.22f + 0.22f) + 0.05f;
-      return drawGenericRes<SDF_OCTA>(fb, time, resFactor);
+int RayMarch::getAccumulatedFrames() {
+  return accumFrames;
+}
 
-    case 5:
-      lerpFactor = fm_sinf(time*4.0f) * 0.5f + 0.5f;
-      return drawGenericRes<SDF_ENVMAP>(fb, time, resFactor);
+void RayMarch::draw(void* fb, float time, int sdfIdx, int resFactor)
+{
+  frameStart = TICKS_READ();
+  updateScene(time, sdfIdx);
 
-    case 6: 
-      lerpFactor = fm_sinf(time*3.0f) * 0.5f + 0.5f;
-      return drawGenericRes<SDF_ENVMAP_2>(fb, time, resFactor);
+  // the last frame can only be reprojected if it was fully drawn in checkerboard mode in the same scene
+  bool useCheckerboard = renderMode == Mode::CHECKERBOARD && resFactor == 1;
+  historyValid = historyValid && useCheckerboard && sdfIdx == historySdfIdx;
 
-    case 7:
-      lerpFactor = fm_sinf(time*2.0f) * 0.5f + 0.5f;
-      return drawGenericRes<SDF_ENVMAP_3>(fb, time, resFactor);
+  switch(sdfIdx)
+  {
+    case 0: drawGenericRes<SDF_MAIN>(fb, time, resFactor); break;
+    case 1: drawGenericRes<SDF_SPHERE>(fb, time, resFactor); break;
+    case 2: drawGenericRes<SDF_CYLINDER>(fb, time, resFactor); break;
+    case 3: drawGenericRes<SDF_TEX>(fb, time, resFactor); break;
+    case 4: drawGenericRes<SDF_OCTA>(fb, time, resFactor); break;
+    case 5: drawGenericRes<SDF_ENVMAP>(fb, time, resFactor); break;
+    case 6: drawGenericRes<SDF_ENVMAP_2>(fb, time, resFactor); break;
+    case 7: drawGenericRes<SDF_ENVMAP_3>(fb, time, resFactor); break;
+    case 8: drawGenericRes<SDF_SPHERE_INF>(fb, time, resFactor); break;
+  }
 
-    case 8:
-      lerpFactor = fm_sinf(time*4.0f) * 0.125f + 0.25f;
-      return drawGenericRes<SDF_SPHERE_INF>(fb, time, resFactor);
+  lastFrame = getFrameState(sdfIdx, resFactor);
+  lastFrameValid = true;
+  accumFrames = 0;
+  accumLine = 0;
+
+  historyValid = useCheckerboard && degradedLines == 0;
+  if(useCheckerboard) {
+    historySdfIdx = sdfIdx;
+    setPrevFrame(fb);
+    prevCamPos = camera.camPos;
+    prevCamDir = camera.camDir;
+    prevRight = right;
+    prevUp = up;
+    swapDepthBuffers();
+    ++checkerFrame;
   }
 }
 
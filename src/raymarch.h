@@ -3,10 +3,58 @@
 * @license MIT
 */
 #pragma once
+#include <cstdint>
 
 namespace RayMarch
 {
+  enum class Mode : uint8_t {
+    SCALED,       // every pixel (or block at lower resolutions) is marched
+    CHECKERBOARD, // full-res only: half the pixels are marched, the rest is reprojected
+    ADAPTIVE,     // full-res only: 1/4 grid, blocks are refined only at edges
+    PROGRESSIVE,  // full-res only: refines from 8x8 blocks down to pixels, for drawing into a visible buffer
+  };
+
   void init();
 
   void draw(void* fb, float time, int sdfIdx, int resFactor);
+
+  /**
+   * Checks if a frame with these parameters would look the same as the last drawn one
+   * (same camera, scene, mode and animation state).
+   * Every scene animates with 'time', so while it advances no frame is static.
+   */
+  bool isStatic(float time, int sdfIdx, int resFactor);
+
+  /**
+   * For static frames: blends a jittered full-res frame into 'fb', which must hold the last one.
+   * Repeated calls converge to an anti-aliased image, after which they do nothing.
+   * With a frame-budget set, a call may only blend part of a frame and continue there the next time.
+   */
+  void accumulate(void* fb, int sdfIdx);
+
+  /**
+   * Number of frames fully accumulated since the last 'draw()'.
+   */
+  int getAccumulatedFrames();
+
+  /**
+   * Full-res only: alternative ways to fill the frame with fewer rays.
+   * Checkerboard marches half the pixels each frame, the others are reprojected from the last frame,
+   * or interpolated if that fails.
+   * Adaptive marches one ray per 4x4 block, then refines blocks at edges to 1/2 or full-res.
+   * Progressive marches every pixel once, but in passes of decreasing block size,
+   * so a full (coarse) image is visible early on when drawing into the front buffer.
+   */
+  void setMode(Mode mode);
+
+  /**
+   * Sets a time limit (in ticks) for 'draw()', 0 to disable.
+   * Lines that are projected to exceed it are drawn at the next lower resolution instead.
+   */
+  void setFrameBudget(uint32_t ticks);
+
+  /**
+   * Number of output lines in the last frame drawn at a lower resolution than requested.
+   */
+  int getDegradedLines();
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Depth (along the camera direction) of each output pixel for the current and last frame.
+// This is used to validate pixels reprojected from the last frame.
+constexpr float DEPTH_SCALE = 1024.0f;
+constexpr uint16_t DEPTH_MISS = 0xFFFF;
+
+static_assert(OUTPUT_WIDTH * OUTPUT_HEIGHT * 2 <= MemMap::DEPTH_BYTES);
+
+uint16_t *depthCurr{nullptr};
+uint16_t *depthPrev{nullptr};
+
+// camera and output of the last frame, only usable if 'historyValid' is set
+constinit bool historyValid = false;
+constinit int historySdfIdx = -1;
+constinit uint32_t checkerFrame = 0;
+const uint16_t *prevFrame{nullptr};
+// rows of 'prevFrame' invalidated in the data-cache since it was set, see 'prevFrameRow()'
+constinit uint32_t prevFrameRowsCached[(OUTPUT_HEIGHT + 31) / 32]{};
+
+constinit fm_vec3_t prevCamPos{};
+constinit fm_vec3_t prevCamDir{};
+constinit fm_vec3_t prevRight{};
+constinit fm_vec3_t prevUp{};
+
+inline void swapDepthBuffers() {
+  auto tmp = depthCurr;
+  depthCurr = depthPrev;
+  depthPrev = tmp;
+}
+
+inline void setPrevFrame(void* fb) {
+  prevFrame = (uint16_t*)((char*)fb + (OFFSET_Y * FB_STRIDE) + OFFSET_X*2);
+  for(auto &mask : prevFrameRowsCached)mask = 0;
+}
+
+/**
+ * Row 'y' of the last frame, read through the cached alias.
+ * The framebuffer was written uncached, so the row gets invalidated before the first read.
+ */
+inline const uint16_t* prevFrameRow(int y) {
+  auto row = (char*)CachedAddr((const char*)prevFrame - OFFSET_X*2 + y * FB_STRIDE);
+  uint32_t bit = 1u << (y & 31);
+  if(!(prevFrameRowsCached[y >> 5] & bit)) {
+    prevFrameRowsCached[y >> 5] |= bit;
+    data_cache_hit_invalidate(row, FB_STRIDE);
+  }
+  return (const uint16_t*)row + OFFSET_X;
+}
+
+inline uint16_t toDepth(float distTotal, const fm_vec3_t &dir, const fm_vec3_t &camDir) {
+  if(distTotal >= renderDist)return DEPTH_MISS;
+  return (uint16_t)fminf(distTotal * Math::dot(dir, camDir) * DEPTH_SCALE, DEPTH_MISS - 1);
+}
+
+/**
+ * Fills in a pixel skipped in checkerboard mode, the left/right neighbours must be marched already.
+ * The depth of the neighbours is used to reproject the pixel into the last frame.
+ * If that lands on a surface with a different depth (disocclusion), or the neighbours
+ * are not coherent (silhouettes), the pixel is interpolated from them instead.
+ * 'rayDir' is the unnormalized ray of the pixel (with a length of 1 along the camera direction).
+ */
+template<SDFConf CONF>
+uint16_t reconstructPixel(const uint16_t *fbRow, uint16_t *depthRow, int x, const fm_vec3_t &rayDir)
+{
+  int xl = x > 0 ? x-1 : x+1;
+  int xr = x < OUTPUT_WIDTH-1 ? x+1 : x-1;
+  uint32_t zl = depthRow[xl];
+  uint32_t zr = depthRow[xr];
+
+  bool isMiss = zl == DEPTH_MISS && zr == DEPTH_MISS;
+  if constexpr (!CONF.shadeNoHit) {
+    if(isMiss) {
+      depthRow[x] = DEPTH_MISS;
+      return CONF.bgColor;
+    }
+  }
+
+  uint32_t zDiff = zl > zr ? (zl - zr) : (zr - zl);
+  uint32_t zMin = zl < zr ? zl : zr;
+  bool isCoherent = isMiss || (zl != DEPTH_MISS && zr != DEPTH_MISS && zDiff*16 < zMin);
+
+  if(historyValid && isCoherent)
+  {
+    // position relative to the last camera, misses are at infinity so only the direction matters
+    float z = (float)(zl + zr) * (0.5f / DEPTH_SCALE);
+    fm_vec3_t pos = isMiss ? rayDir : ((camera.camPos - prevCamPos) + rayDir * z);
+
+    float zPrev = Math::dot(pos, prevCamDir);
+    if(zPrev > 0.01f) {
+      float zPrevInv = 1.0f / zPrev;
+      float px = Math::dot(pos, prevRight) * zPrevInv * OUTPUT_HEIGHT + (OUTPUT_WIDTH/2 + 0.5f);
+      float py = Math::dot(pos, prevUp) * zPrevInv * OUTPUT_HEIGHT + (OUTPUT_HEIGHT/2 + 0.5f);
+
+      if(px >= 0 && py >= 0 && px < OUTPUT_WIDTH && py < OUTPUT_HEIGHT) {
+        int idxPrev = (int)py * OUTPUT_WIDTH + (int)px;
+        uint32_t depthOld = depthPrev[idxPrev];
+
+        bool isValid;
+        if(isMiss) {
+          isValid = depthOld == DEPTH_MISS;
+        } else {
+          int32_t zExpected = (int32_t)(zPrev * DEPTH_SCALE);
+          int32_t zError = (int32_t)depthOld - zExpected;
+          isValid = depthOld != DEPTH_MISS && (zError < 0 ? -zError : zError)*16 < zExpected;
+        }
+
+        if(isValid) {
+          depthRow[x] = isMiss ? DEPTH_MISS : (uint16_t)(z * DEPTH_SCALE);
+          return prevFrameRow((int)py)[(int)px];
+        }
+      }
+    }
+  }
+
+  // interpolate, on edges take the closer pixel to keep silhouettes sharp
+  depthRow[x] = zMin;
+  if(isCoherent)return Color::average(fbRow[xl], fbRow[xr]);
+  return fbRow[zl < zr ? xl : xr];
+}
@@ -16,4 +16,7 @@
 #define DMEM_LERP_B 78
 
 #define DMEM_INIT_DIST 80
-#define DMEM_RENDER_DIST 84
\ No newline at end of file
+#define DMEM_RENDER_DIST 84
+
+#define DMEM_MATERIAL_A 88
+#define DMEM_MATERIAL_B 92
@@ -67,4 +67,9 @@ namespace UCode
     distTotal.val = idx == 0 ? SP_DMEM[DMEM_TOTAL_DIST_A/4] : SP_DMEM[DMEM_TOTAL_DIST_B/4];
     return distTotal;
   }
+
+  // primitive the ray hit, only written by 'RayMarch_Main': 0 = torus, 1 = sphere
+  inline int getMaterial(int idx) {
+    return (idx == 0 ? SP_DMEM[DMEM_MATERIAL_A/4] : SP_DMEM[DMEM_MATERIAL_B/4]) >> 31;
+  }
 }
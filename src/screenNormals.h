@@ -0,0 +1,115 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Full-res mode that derives normals from the hit positions of neighbouring pixels instead of 'fnNorm',
+// so the cost doesn't depend on the SDF. A row needs the one below it for all 4 neighbours, so rows are
+// marched two ahead: each pixel of row 'y' is shaded while the RSP marches the next pair of row 'y+2'.
+// Per axis the neighbour closer in depth is used, only if neither is on the same surface the analytic normal is.
+struct ScreenHit {
+  fm_vec3_t pos;
+  fm_vec3_t dir;
+  float dist;
+  int material;
+};
+
+// ring of the rows 'y-1' to 'y+1' around the shaded one, plus 'y+2' being marched
+constinit ScreenHit screenHits[4][OUTPUT_WIDTH]{};
+
+inline bool isSameSurface(const ScreenHit &hit, const ScreenHit &other) {
+  return other.dist < renderDist && fabsf(other.dist - hit.dist) * 16.0f < hit.dist;
+}
+
+// derivative of the position towards 'next', using 'prev' instead if that is closer in depth
+inline bool screenDerivative(const ScreenHit &hit, const ScreenHit *prev, const ScreenHit *next, fm_vec3_t &res)
+{
+  bool usePrev = prev && isSameSurface(hit, *prev);
+  bool useNext = next && isSameSurface(hit, *next);
+  if(usePrev && useNext) {
+    usePrev = fabsf(prev->dist - hit.dist) < fabsf(next->dist - hit.dist);
+  }
+  if(usePrev) {
+    res = hit.pos - prev->pos;
+    return true;
+  }
+  if(useNext) {
+    res = next->pos - hit.pos;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Draws the frame from the top, returns the line it stopped at.
+ * Like 'drawGeneric()' it stops early if the remaining lines are projected to miss the frame-budget.
+ */
+template<SDFConf CONF>
+int drawScreenNormals(void* fb)
+{
+  static_assert(CONF.faces == nullptr, "faces already avoid 'fnNorm'");
+  fm_vec3_t camPos = camera.camPos;
+  auto buff = (uint16_t*)((char*)fb + (OFFSET_Y * FB_STRIDE) + OFFSET_X*2);
+
+  auto shadePixel = [&](int y, int x) {
+    const ScreenHit *row = screenHits[y % 4];
+    const ScreenHit *rowPrev = y > 0 ? screenHits[(y+3) % 4] : nullptr;
+    const ScreenHit *rowNext = y+1 < OUTPUT_HEIGHT ? screenHits[(y+1) % 4] : nullptr;
+    uint16_t &out = buff[y * (FB_STRIDE/2) + x];
+
+    const ScreenHit &hit = row[x];
+    fm_vec3_t dx, dy;
+    bool hasNormal = hit.dist < renderDist
+      && screenDerivative(hit, x > 0 ? &row[x-1] : nullptr, x+1 < OUTPUT_WIDTH ? &row[x+1] : nullptr, dx)
+      && screenDerivative(hit, rowPrev ? &rowPrev[x] : nullptr, rowNext ? &rowNext[x] : nullptr, dy);
+
+    if(!hasNormal) {
+      out = shadeSample<CONF>(hit.dist, hit.dir, camPos, hit.material);
+      return;
+    }
+
+    auto norm = Math::normalizeUnsafe(Math::cross(dx, dy));
+    if(Math::dot(norm, hit.dir) > 0)norm = -norm;
+    out = CONF.fnShade(norm, hit.pos, hit.dir, hit.dist, hit.material);
+  };
+
+  // 'fnPixel(x)' runs after each sample, while the RSP is busy with the next pair
+  auto marchRow = [&](int y, auto fnPixel) {
+    ScreenHit *row = screenHits[y % 4];
+    auto rowDir = rayStepY * (float)y + rayDirOrigin;
+    marchSamples<CONF>(OUTPUT_WIDTH,
+      [&](int x) { return rowDir + rayStepX * (float)x; },
+      [&](int x, float distTotal, const fm_vec3_t &dir, int material) {
+        ScreenHit &hit = row[x];
+        hit.dir = dir;
+        hit.dist = distTotal;
+        hit.material = material;
+        if(distTotal < renderDist) {
+          // the RSP stops at a distance too coarse for derivatives, one more step gets it onto the surface
+          hit.pos = camPos + (dir * distTotal);
+          hit.pos += dir * CONF.fnSDF(hit.pos);
+        }
+        fnPixel(x);
+      }
+    );
+  };
+
+  uint32_t ticksStart = TICKS_READ();
+  marchRow(0, [](int) {});
+  marchRow(1, [](int) {});
+  for(int y=0; y<OUTPUT_HEIGHT; ++y)
+  {
+    // only stop on even lines, the 1/2 res fallback continues in blocks of 2
+    if(frameBudget != 0 && y != 0 && (y % 2) == 0) {
+      if(isOverBudget(ticksStart, y, OUTPUT_HEIGHT - y))return y;
+    }
+
+    if(y+2 < OUTPUT_HEIGHT) {
+      marchRow(y+2, [&](int x) { shadePixel(y, x); });
+    } else {
+      for(int x=0; x<OUTPUT_WIDTH; ++x)shadePixel(y, x);
+    }
+  }
+  return OUTPUT_HEIGHT;
+}
@@ -94,6 +94,17 @@ namespace SDF {
     return Math::normalizeUnsafe(n);
   }
 
+  // face index of the octahedron, matches 'OCTA_FACE_NORMALS' and 'octaNormals()'
+  int octaFace(const fm_vec3_t& p_) {
+    auto p = Math::fastClamp(p_);
+    return (p.x >= 0 ? 0b001 : 0) | (p.y >= 0 ? 0b010 : 0) | (p.z >= 0 ? 0b100 : 0);
+  }
+
+  constexpr float OCTA_N = 0.57735027f; // 1/sqrt(3)
+  constexpr fm_vec3_t OCTA_FACE_NORMALS[8]{
+    {-OCTA_N, -OCTA_N, -OCTA_N}, { OCTA_N, -OCTA_N, -OCTA_N}, {-OCTA_N,  OCTA_N, -OCTA_N}, { OCTA_N,  OCTA_N, -OCTA_N},
+    {-OCTA_N, -OCTA_N,  OCTA_N}, { OCTA_N, -OCTA_N,  OCTA_N}, {-OCTA_N,  OCTA_N,  OCTA_N}, { OCTA_N,  OCTA_N,  OCTA_N},
+  };
 }
 
 #pragma GCC pop_options
\ No newline at end of file
@@ -0,0 +1,45 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Per-scene setup of the ray-marcher, drawing functions are specialized for each one.
+// Shared with the host tests in 'tools/shadetest'.
+typedef float (*FuncSDF)(const fm_vec3_t&);
+typedef fm_vec3_t (*FuncNorm)(const fm_vec3_t&);
+typedef uint32_t (*FuncShade)(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int material);
+typedef uint16_t (*FuncNormalLut)(const fm_vec3_t &norm);
+typedef int (*FuncFace)(const fm_vec3_t &hitPos);
+typedef int32_t (*FuncFaceLight)(const fm_vec3_t &norm, const fm_vec3_t &dir);
+typedef uint32_t (*FuncShadeFace)(int face, const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist);
+
+// primitives of 'SDF::main', see 'SDFConf::materials'
+constexpr int MATERIAL_TORUS = 0;
+constexpr int MATERIAL_SPHERE = 1;
+
+// SDFs with a finite set of normals, see 'faceCache.h'
+struct FaceSet
+{
+  FuncFace fnFace;
+  const fm_vec3_t *normals;
+  int count;
+  FuncFaceLight fnLight; // lighting per face, baked once per frame using the camera direction
+  FuncShadeFace fnShade;
+};
+
+struct SDFConf
+{
+  FuncSDF fnSDF;
+  FuncNorm fnNorm;
+  FuncShade fnShade;
+  uint32_t fnUcode;
+  uint32_t bgColor = 0;
+  float renderDist;
+  bool shadeNoHit = false;
+  FuncNormalLut fnNormalLut = nullptr; // bakes the LUT used by 'fnShade', see 'normalLut.h'
+  const FaceSet *faces = nullptr; // replaces 'fnNorm' and 'fnShade' for hits if set
+  bool screenNormals = false; // full-res uses normals from neighbouring hits, see 'screenNormals.h'
+  bool tiledLights = false; // culls 'lights' per screen tile, see 'lights.h' and 'tiledLights.h'
+  bool materials = false; // passes the primitive that was hit to 'fnShade', only 'RayMarch_Main' outputs it
+};
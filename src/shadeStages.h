@@ -0,0 +1,219 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Shaders composed from stages at compile-time, e.g.:
+//   shadeStages<Stage::Lambert<0.0f>, Stage::PaletteStripes, Stage::Lit, Stage::FogMix<22,22,31>>
+// Each stage is a struct with a static 'apply()' working on the context, they run in order and get fully inlined
+// into the one function used as 'SDFConf::fnShade'. Colors and factors are fixed-point, see 'colorFP.h'.
+namespace Stage
+{
+  struct Ctx
+  {
+    const fm_vec3_t &norm;
+    const fm_vec3_t &hitPos;
+    const fm_vec3_t &dir;
+    float dist;
+
+    ColorFP::RGB col{};
+    int32_t light{ColorFP::ONE};
+    int face{0}; // only for 'shadeStagesFace'
+    int material{0}; // see 'SDFConf::materials'
+  };
+
+  // light coming from the camera, with a minimum of 'AMBIENT'
+  template<float AMBIENT>
+  struct Lambert {
+    static int32_t light(const fm_vec3_t &norm, const fm_vec3_t &dir) {
+      float light = fmaxf(-Math::dot(norm, dir), 0);
+      if constexpr (AMBIENT != 0.0f)light = fminf(light + AMBIENT, 1);
+      return ColorFP::factor(light);
+    }
+
+    static void apply(Ctx &ctx) {
+      ctx.light = light(ctx.norm, ctx.dir);
+    }
+  };
+
+  // light of the face baked by 'updateFaceCache()'
+  struct FaceLight {
+    static void apply(Ctx &ctx) {
+      ctx.light = faceLight[ctx.face];
+    }
+  };
+
+  // rainbow along the height, with alternating bright and dark stripes
+  struct PaletteStripes {
+    static void apply(Ctx &ctx) {
+      // height in stripes as 24.8, used for both the stripes themselves and the palette
+      constexpr int32_t PALETTE_STEP = (int32_t)(2.0f * Palette::UNITS_PER_RAD * 65536.0f / (24.0f * 256.0f));
+      int32_t y = (int32_t)(ctx.hitPos.y * (24.0f * 256.0f));
+      int32_t base = (y / 256) & 1 ? 5 : 15;
+
+      const auto &col = Palette::get(paletteRainbowFP, (y * PALETTE_STEP) >> 16);
+      ctx.col = {col.v * base};
+    }
+  };
+
+  // rainbow indexed by the unit-cell the hit is in
+  template<float BASE>
+  struct PaletteCell {
+    static void apply(Ctx &ctx) {
+      const auto &hitPos = ctx.hitPos;
+      int phase = (int)(hitPos.x+0.5f) + (int)(hitPos.z+0.5f) + (int)(hitPos.y+0.5f);
+      ctx.col = ColorFP::scale(
+        Palette::get(paletteRainbowFP, (phase * FLAT_PHASE_STEP) >> 8), (int32_t)(BASE * ColorFP::ONE)
+      );
+    }
+  };
+
+  // sum of the point lights of the current tile (see 'lights.h') and a white 'AMBIENT',
+  // applied to the color directly. Only the ambient is scaled by 'ctx.light', e.g. the occlusion of 'CellAO'.
+  template<float AMBIENT>
+  struct TileLights {
+    static void apply(Ctx &ctx) {
+      float ambient = AMBIENT * ctx.light * (1.0f / ColorFP::ONE);
+      fm_vec3_t sum{ambient, ambient, ambient};
+      uint32_t mask = tileLightMaskHasGrid ? tileLightMask : (tileLightMask & lightGridMask(ctx.dir));
+      while(mask) {
+        const auto &light = lights[__builtin_ctz(mask)];
+        mask &= mask - 1;
+
+        fm_vec3_t toLight = light.pos - ctx.hitPos;
+        float falloff = Math::dot(toLight, toLight) / (light.range * light.range);
+        if(falloff >= 1.0f)continue;
+
+        float lightPoint = Math::dot(ctx.norm, Math::normalizeUnsafe(toLight));
+        lightPoint = fmaxf(lightPoint, 0);
+        lightPoint = fminf(lightPoint + 0.0125f, 1);
+        sum += light.color * (lightPoint * (1.0f - falloff));
+      }
+      sum = Math::min(sum, {1, 1, 1});
+      // different factor per channel, so this can't use the packed 'ColorFP::scale()'
+      ctx.col = ColorFP::fromFP(
+        (ctx.col.r() * ColorFP::factor(sum.x)) >> 8,
+        (ctx.col.g() * ColorFP::factor(sum.y)) >> 8,
+        (ctx.col.b() * ColorFP::factor(sum.z)) >> 8
+      );
+    }
+  };
+
+  // baked ambient-occlusion of the unit-cell as the light, see 'cellVolume.h'
+  struct CellAO {
+    static void apply(Ctx &ctx) {
+      auto p = Math::fastClamp(ctx.hitPos);
+      ctx.light = cellAO[cellVolIndex(p.z)][cellVolIndex(p.y)][cellVolIndex(p.x)] + 1;
+    }
+  };
+
+  // one of 4 fixed colors per unit-cell
+  struct CellColors {
+    static void apply(Ctx &ctx) {
+      constexpr ColorFP::RGB COLORS[4]{
+        ColorFP::fromInt(31, 15, 15), ColorFP::fromInt(15, 31, 15),
+        ColorFP::fromInt(31, 31, 15), ColorFP::fromInt(31, 31, 31),
+      };
+      const auto &hitPos = ctx.hitPos;
+      int phase = (int)(hitPos.x+0.5f) + (int)(hitPos.z+0.5f) + (int)(hitPos.y+0.5f);
+      ctx.col = COLORS[(phase >> 1) & 0b11];
+    }
+  };
+
+  // textured and normal-mapped cylinders, lit by 'lightPos' with a warm light over a blue ambient
+  struct Tex {
+    static void apply(Ctx &ctx) {
+      auto tex = sampleTex(ctx.norm, ctx.hitPos, ctx.dist);
+      float light = tex.lightPoint;
+      // different factor per channel, the 5-bit channel times a 0.8 factor is already 5.8
+      ctx.col = ColorFP::fromFP(
+        (tex.color >> 11)         * ColorFP::factor(fminf(light + 0.15f, 1)),
+        ((tex.color >> 6) & 0x1F) * ColorFP::factor(fminf(light * 0.8f + 0.15f, 1)),
+        (tex.color & 0x1F)        * ColorFP::factor(fminf(light * 0.6f + 0.3f, 1))
+      );
+    }
+  };
+
+  // env-map color cached in 'normalLut'
+  struct EnvLut {
+    static void apply(Ctx &ctx) {
+      uint16_t tex = normalLutColor(ctx.norm);
+      ctx.col = ColorFP::fromInt(tex >> 11, (tex >> 6) & 0b11111, (tex >> 1) & 0b11111);
+    }
+  };
+
+  // applies the light to the color
+  struct Lit {
+    static void apply(Ctx &ctx) {
+      ctx.col = ColorFP::scale(ctx.col, ctx.light);
+    }
+  };
+
+  // fades into the fog color towards the render distance
+  template<int R, int G, int B>
+  struct FogMix {
+    static void apply(Ctx &ctx) {
+      float distNormInv = (renderDist - ctx.dist) * renderDistInv;
+      ctx.col = ColorFP::mix(ColorFP::fromInt(R, G, B), ctx.col, ColorFP::factor(distNormInv));
+    }
+  };
+
+  // fades to black towards the render distance
+  struct FogFade {
+    static void apply(Ctx &ctx) {
+      float distNormInv = (renderDist - ctx.dist) * renderDistInv;
+      ctx.col = ColorFP::scale(ctx.col, ColorFP::factor(distNormInv));
+    }
+  };
+
+  // inverts the color towards white at grazing angles, weaker in the distance
+  struct Fresnel {
+    static void apply(Ctx &ctx) {
+      float distNormInv = fminf(((renderDist - ctx.dist) * renderDistInv) * 2.0f, 1.0f);
+      float angle = 1.0f - (Math::dot(ctx.norm, ctx.dir) * 0.5f + 0.5f);
+      int32_t f = ColorFP::factor(angle * distNormInv);
+
+      ctx.col = ColorFP::invert(ColorFP::scale(ctx.col, f));
+    }
+  };
+}
+
+template<typename... STAGES>
+inline uint32_t shadeStages(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int material)
+{
+  Stage::Ctx ctx{norm, hitPos, dir, dist};
+  ctx.material = material;
+  (STAGES::apply(ctx), ...);
+  return ColorFP::pack(ctx.col);
+}
+
+// same for 'FaceSet::fnShade', which also knows the face index
+template<typename... STAGES>
+inline uint32_t shadeStagesFace(int face, const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist)
+{
+  Stage::Ctx ctx{norm, hitPos, dir, dist};
+  ctx.face = face;
+  (STAGES::apply(ctx), ...);
+  return ColorFP::pack(ctx.col);
+}
+
+// fixed-point versions of the float shaders in 'shading.h', which are kept as a reference
+constexpr FuncShade shadeCylinderStages = shadeStages<
+  Stage::Lambert<0.0f>, Stage::PaletteStripes, Stage::Lit, Stage::FogMix<22, 22, 31>
+>;
+constexpr FuncShade shadeFlatStages = shadeStages<
+  Stage::Lambert<0.25f>, Stage::PaletteCell<15.5f>, Stage::Lit, Stage::FogMix<31, 11, 11>
+>;
+constexpr FuncShadeFace shadeFlatFaceStages = shadeStagesFace<
+  Stage::FaceLight, Stage::PaletteCell<15.5f>, Stage::Lit, Stage::FogMix<31, 11, 11>
+>;
+constexpr FuncShade shadeTileLightsStages = shadeStages<
+  Stage::CellColors, Stage::CellAO, Stage::TileLights<0.15f>, Stage::FogFade
+>;
+constexpr FuncShade shadeTexStages = shadeStages<
+  Stage::Tex, Stage::FogFade
+>;
+constexpr FuncShade shadeEnvLutStages = shadeStages<
+  Stage::EnvLut, Stage::Fresnel
+>;
@@ -4,19 +4,140 @@
 */
 #pragma once
 
-struct TexPixel
+// Material textures with normals are stored as two planes, each with the full mip-chain:
+// RGBA5515 colors (bit 5 marks a normal with Z=1), followed by the tangent-space normals.
+struct TexNormal
 {
   int8_t normA;
   int8_t normB;
-  uint16_t color;
 };
+constexpr int TEX_NORMAL_PLANE = TEXTURE_TEXELS * sizeof(uint16_t);
+static_assert(TEX_NORMAL_PLANE + TEXTURE_TEXELS * sizeof(TexNormal) == TEXTURE_BYTES);
 
 constexpr int TEX_DIM = 256;
 
-constexpr int SKY_WIDTH = 1024;
-constexpr int SKY_HEIGHT = 512;
+namespace Color
+{
+  // average of two RGBA5551 colors, drops the lowest bit of each channel and alpha
+  constexpr uint16_t average(uint16_t a, uint16_t b) {
+    constexpr uint16_t MASK = 0b01111'01111'01111'0;
+    return ((a >> 1) & MASK) + ((b >> 1) & MASK);
+  }
+
+  // moves the channels 10 bits apart, so that weighted colors (weights adding up to 16) can be summed directly
+  constexpr uint32_t spread(uint16_t c) {
+    return ((c & 0xF800) << 9) | ((c & 0x07C0) << 4) | ((c & 0x003E) >> 1);
+  }
+
+  // converts a sum of spread colors back, drops alpha
+  constexpr uint16_t packSpread(uint32_t sum) {
+    return ((sum >> 13) & 0xF800) | ((sum >> 8) & 0x07C0) | ((sum >> 3) & 0x003E);
+  }
+
+  // sum of the per-channel differences
+  constexpr int distance(uint16_t a, uint16_t b) {
+    int dr = (a >> 11) - (b >> 11);
+    int dg = ((a >> 6) & 0x1F) - ((b >> 6) & 0x1F);
+    int db = ((a >> 1) & 0x1F) - ((b >> 1) & 0x1F);
+    return (dr < 0 ? -dr : dr) + (dg < 0 ? -dg : dg) + (db < 0 ? -db : db);
+  }
+}
+
+// SWAR versions of the above for 4 RGBA5551 pixels in a 64-bit GPR, as loaded/stored from the framebuffer.
+// Each channel gets its own register with 16-bit lanes, so weighted sums can't overflow into the next pixel.
+namespace Color4
+{
+  constexpr uint64_t LANES = 0x0001'0001'0001'0001;
+  constexpr uint64_t CHANNEL_MASK = 0x1F * LANES;
+
+  constexpr uint64_t splat(uint16_t c) {
+    return c * LANES;
+  }
+
+  // same as summing spread colors with weights (16-w) and w, drops alpha.
+  // Rounds to nearest, truncating would only let small differences pull the result down.
+  constexpr uint64_t mix(uint64_t a, uint64_t b, uint32_t w) {
+    auto mixChannel = [&](int shift) {
+      uint64_t ca = (a >> shift) & CHANNEL_MASK;
+      uint64_t cb = (b >> shift) & CHANNEL_MASK;
+      return (((ca * (16 - w) + cb * w + 8 * LANES) >> 4) & CHANNEL_MASK) << shift;
+    };
+    return mixChannel(11) | mixChannel(6) | mixChannel(1);
+  }
+  static_assert(mix(splat(0xFFFE), splat(0), 8) == splat(0b10000'10000'10000'0));
+  static_assert(mix(splat(15 << 1), splat(10 << 1), 1) == splat(15 << 1));
+}
+
+namespace Tex
+{
+  constexpr int TILE_DIM = 4;
+
+  /**
+   * Index of a texel in a DIM x DIM texture, which are stored in 4x4 tiles (see 'imgconv').
+   * Neighbours in both directions then mostly share a cache line, since UVs rarely follow the rows.
+   */
+  constexpr int tiledIndex(int x, int y, int dim) {
+    return ((y & ~(TILE_DIM-1)) * dim) + ((x & ~(TILE_DIM-1)) * TILE_DIM)
+         + ((y & (TILE_DIM-1)) * TILE_DIM) + (x & (TILE_DIM-1));
+  }
+
+  template<int DIM>
+  constexpr int tiledIndex(int x, int y) {
+    static_assert((DIM & (DIM-1)) == 0);
+    return tiledIndex(x, y, DIM);
+  }
+  static_assert(tiledIndex<256>(5, 6) == (1 * 64 + 1) * 16 + 2*4 + 1);
+
+  // material textures are followed by their mip-chain, down to a single tile
+  constexpr int MIP_LEVELS = 7;
+
+  // offset (in texels) of a mip level from the start of the texture
+  template<int DIM>
+  constexpr int mipOffset(int level) {
+    int dimLevel = DIM >> level;
+    return (DIM*DIM - dimLevel*dimLevel) * 4 / 3;
+  }
+  static_assert(mipOffset<256>(2) == 256*256 + 128*128);
+  static_assert(mipOffset<TEX_DIM>(MIP_LEVELS) == TEXTURE_TEXELS);
+
+  /**
+   * Picks the level at which a texel covers about one pixel.
+   * 'texelsPerUnit' is the density of the texture on the surface (in texels per world-unit).
+   */
+  inline int mipLevel(float dist, float texelsPerUnit) {
+    int footprint = (int)(dist * (pixelSize * texelsPerUnit));
+    if(footprint <= 1)return 0;
+    return std::min(31 - __builtin_clz(footprint), MIP_LEVELS-1);
+  }
+
+  // CI8: a palette of 256 RGBA16 colors, followed by one index per texel (incl. the mip-chain)
+  constexpr int PALETTE_BYTES = 256 * 2;
+  constexpr int CI8_BYTES = PALETTE_BYTES + TEXTURE_TEXELS;
+
+  inline uint16_t fetchCI8(const uint8_t *tex, int idx) {
+    auto palette = (const uint16_t*)tex;
+    return palette[tex[PALETTE_BYTES + idx]];
+  }
+
+  // block-compressed: each tile is stored as two RGBA16 endpoints and a 2-bit weight per texel.
+  // weights are in 1/16 of the second endpoint (0, 1/3, 2/3, 1)
+  constexpr uint32_t BLOCK_WEIGHTS[4] = {0, 5, 11, 16};
+
+  inline uint16_t fetchBlock(const uint32_t *tex, int x, int y, int dim) {
+    int idx = tiledIndex(x, y, dim);
+    const uint32_t *block = tex + (idx / (TILE_DIM*TILE_DIM)) * 2;
+    uint32_t weight = BLOCK_WEIGHTS[(block[1] >> ((idx % (TILE_DIM*TILE_DIM)) * 2)) & 0b11];
+    return Color::packSpread(
+      Color::spread(block[0] >> 16) * (16 - weight) + Color::spread(block[0] & 0xFFFF) * weight
+    );
+  }
+}
 
-inline uint32_t shadeResultA(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist)
+// octahedral map, block-compressed, see 'imgconv'
+constexpr int SKY_DIM = 512;
+constexpr int SKY_BYTES = SKY_DIM * SKY_DIM / 2;
+
+inline uint32_t shadeResultA(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int)
 {
   float distNorm = (renderDist - dist);
   float distNormInv = distNorm * renderDistInv;
@@ -56,7 +177,7 @@ inline uint32_t shadeResultA(const fm_vec3_t &norm, const fm_vec3_t &hitPos, con
   ;
 }
 
-inline uint32_t shadeResultCylinder(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist)
+inline uint32_t shadeResultCylinder(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int)
 {
   float distNorm = (renderDist - dist);
   float distNormInv = distNorm * renderDistInv;
@@ -64,19 +185,12 @@ inline uint32_t shadeResultCylinder(const fm_vec3_t &norm, const fm_vec3_t &hitP
   float light = -Math::dot(norm, dir);
   light = fmaxf(light, 0);
 
-  float s = hitPos.y * 24;
-  float base = ((int)(s) & 1) ? 5.0f : 15.0f;
-  s = hitPos.y*2;
-
-  fm_vec3_t col{
-    Math::sinApprox(s + 0.0f) * base + base,
-    Math::sinApprox(s + 2.0f) * base + base,
-    Math::sinApprox(s + 4.0f) * base + base,
-  };
+  float base = ((int)(hitPos.y * 24) & 1) ? 5.0f : 15.0f;
+  fm_vec3_t col = Palette::get(paletteRainbow, (int)(hitPos.y * (2.0f * Palette::UNITS_PER_RAD)));
 
   //col *= (distNormInv * light);
   col = Math::mix(
-    {22.0f, 22.0f, 31.0f}, col * light, distNormInv
+    {22.0f, 22.0f, 31.0f}, col * (light * base), distNormInv
   );
 
   return ((int)(col.x) << 11) |
@@ -85,7 +199,10 @@ inline uint32_t shadeResultCylinder(const fm_vec3_t &norm, const fm_vec3_t &hitP
   ;
 }
 
-inline uint32_t shadeResultFlat(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist)
+// 32 radians per cell-phase, in 24.8 fixed-point palette units
+constexpr int FLAT_PHASE_STEP = (int)(32.0f * Palette::UNITS_PER_RAD * 256.0f);
+
+inline uint32_t shadeResultFlat(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int)
 {
   float distNorm = (renderDist - dist);
   float distNormInv = distNorm * renderDistInv;
@@ -95,18 +212,12 @@ inline uint32_t shadeResultFlat(const fm_vec3_t &norm, const fm_vec3_t &hitPos,
   light = fminf(light + 0.25f, 1);
 
   int phase = (int)(hitPos.x+0.5f) + (int)(hitPos.z+0.5f) + (int)(hitPos.y+0.5f);
-  float s = phase * 32;
 
   constexpr float base = 15.5f;
-
-  fm_vec3_t col{
-    Math::sinApprox(s + 0.0f) * base + base,
-    Math::sinApprox(s + 2.0f) * base + base,
-    Math::sinApprox(s + 4.0f) * base + base,
-  };
+  fm_vec3_t col = Palette::get(paletteRainbow, (phase * FLAT_PHASE_STEP) >> 8);
 
   col = Math::mix(
-    {31.0f, 11.0f, 11.0f}, col * light, distNormInv
+    {31.0f, 11.0f, 11.0f}, col * (light * base), distNormInv
   );
 
   return ((int)(col.x) << 11) |
@@ -115,7 +226,7 @@ inline uint32_t shadeResultFlat(const fm_vec3_t &norm, const fm_vec3_t &hitPos,
   ;
 }
 
-inline uint32_t shadeResultPointLight(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist)
+inline uint32_t shadeResultPointLight(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int)
 {
   float distNorm = (renderDist - dist);
   float distNormInv = distNorm * renderDistInv;
@@ -171,13 +282,39 @@ inline fm_vec3_t rotVecY(const fm_vec3_t &v, float angle)
   return rotVecY(v, fm_cosf(angle), fm_sinf(angle));
 }
 
-constinit int8_t normalZLookup[256][256]{};
-
-inline uint32_t shadeResultTex(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist)
+// Z of a tangent-space normal indexed by its squared XY length (in int8 units) shifted down,
+// values are in the same units as XY so all three can be scaled by 1/128 together.
+namespace NormalZ
 {
-  float distNorm = (renderDist - dist);
-  float distNormInv = distNorm * renderDistInv;
+  constexpr int SHIFT = 6;
+  constexpr int SIZE = ((128*128*2) >> SHIFT) + 1;
+
+  struct Table { float z[SIZE]; };
+
+  constexpr Table TABLE = []() {
+    Table t{};
+    for(int i=0; i<SIZE; ++i) {
+      float lenSq = (float)((i << SHIFT) + (1 << (SHIFT-1))) * (1.0f / (128.0f * 128.0f));
+      t.z[i] = Math::sqrtConst(1.0f - lenSq) * 128.0f;
+    }
+    return t;
+  }();
 
+  inline float get(int a, int b) {
+    return TABLE.z[(a*a + b*b) >> SHIFT];
+  }
+}
+
+constexpr float NORMAL_MAP_DIST = 4.0f;
+
+// texel and tangent-space light of a hit on the textured cylinders, shared by 'shadeResultTex' and 'Stage::Tex'
+struct TexSample {
+  uint16_t color;
+  float lightPoint;
+};
+
+inline TexSample sampleTex(const fm_vec3_t &norm, const fm_vec3_t &hitPos, float dist)
+{
   int phase = (int)(hitPos.x+0.5f) + (int)(hitPos.z+0.5f);
 
   float angleY = fm_atan2f(norm.z, norm.x);
@@ -194,47 +331,54 @@ inline uint32_t shadeResultTex(const fm_vec3_t &norm, const fm_vec3_t &hitPos, c
     (int)(uv[1]) & (TEX_DIM-1),
   };
 
-  TexPixel* texData;
+  const uint8_t* texData;
   switch (phase & 0b11) {
     default:
-    case 0: texData = (TexPixel*)MemMap::TEX0_CACHED; break;
-    case 1: texData = (TexPixel*)MemMap::TEX1_CACHED; break;
-    case 2: texData = (TexPixel*)MemMap::TEX2_CACHED; break;
+    case 0: texData = (const uint8_t*)MemMap::TEX0_CACHED; break;
+    case 1: texData = (const uint8_t*)MemMap::TEX1_CACHED; break;
+    case 2: texData = (const uint8_t*)MemMap::TEX2_CACHED; break;
   }
 
-  const TexPixel& tex = texData[uvPixel[1] * TEX_DIM + uvPixel[0]];
+  // density along V, which is the higher one for the cylinders in this scene
+  int mip = Tex::mipLevel(dist, 1.2f * TEX_DIM);
+  int texIdx = Tex::mipOffset<TEX_DIM>(mip) + Tex::tiledIndex(uvPixel[0] >> mip, uvPixel[1] >> mip, TEX_DIM >> mip);
+  uint16_t texColor = ((const uint16_t*)texData)[texIdx];
+
+  // instead of rotating the texture normal into world-space, the light is moved into the tangent-space.
+  // the basis around Y is the geometric normal itself, so this is the inverse of 'rotVecY(v, norm.x, norm.z)'
+  fm_vec3_t lightTex{
+     norm.x * lightPos.x + norm.z * lightPos.z,
+     lightPos.y,
+    -norm.z * lightPos.x + norm.x * lightPos.z,
+  };
+  float lightPoint = lightTex.z;
+
+  // normal-maps are barely visible further away, so only the color plane is fetched there
+  if(dist < NORMAL_MAP_DIST && !(texColor & (1<<5))) { // bit 5 marks the Z component to be 1
+    const TexNormal &tex = ((const TexNormal*)(texData + TEX_NORMAL_PLANE))[texIdx];
+    lightPoint = (
+      tex.normA * lightTex.x + tex.normB * lightTex.y + NormalZ::get(tex.normA, tex.normB) * lightTex.z
+    ) * (1.0f / 128.0f);
+  }
+
+  return {texColor, fmaxf(lightPoint, 0)};
+}
+
+inline uint32_t shadeResultTex(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int)
+{
+  float distNorm = (renderDist - dist);
+  float distNormInv = distNorm * renderDistInv;
+
+  auto tex = sampleTex(norm, hitPos, dist);
 
   fm_vec3_t col;
   col.x = (tex.color >> 11);
   col.y = (tex.color >> 6) & 0x1F;
   col.z = (tex.color) & 0x1F;
 
-  fm_vec3_t normTex = {
-    (tex.normA * (1.0f / 128.0f)),
-    (tex.normB * (1.0f / 128.0f)),
-    0,
-  };
-
-  //auto held = joypad_get_buttons_held(JOYPAD_PORT_1);
-
-  if (tex.color & (1<<5)) { // marks the Z component to be 1
-    // simplified version of the rotate assuming Z=1
-    normTex.z = 1.0f;
-    normTex = rotVecY(normTex, norm.x, norm.z);
-  } else {
-    float sq = normTex.x*normTex.x - normTex.y*normTex.y;
-    if (sq < 0.95f) {
-      normTex.z = sqrtf(1.0f - sq);
-    }
-    normTex = rotVecY(normTex, norm.x, norm.z);
-  }
-
   constexpr auto ambientColor = fm_vec3_t{0.15f, 0.15f, 0.3f};
 
-  float lightPoint = Math::dot(normTex, lightPos);
-  lightPoint = fmaxf(lightPoint, 0);
-
-  fm_vec3_t lightColor = fm_vec3_t{1.0f, 0.8f, 0.6f} * lightPoint;
+  fm_vec3_t lightColor = fm_vec3_t{1.0f, 0.8f, 0.6f} * tex.lightPoint;
   lightColor = Math::min(lightColor + ambientColor, {1,1,1});
   col *= lightColor;
   col *= distNormInv;
@@ -245,18 +389,16 @@ inline uint32_t shadeResultTex(const fm_vec3_t &norm, const fm_vec3_t &hitPos, c
   ;
 }
 
-inline uint32_t shadeResultEnv(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist)
-{
-  float distNorm = (renderDist - dist);
-  float distNormInv = distNorm * renderDistInv;
-  distNormInv = fminf((distNormInv * 2.0f), 1.0f);
+// the env-map is indexed by the normal, so its density on the surface depends on the curvature
+constexpr float ENV_TEXELS_PER_UNIT = 0.4f * TEX_DIM * 2.0f;
 
+// texture color of the env-map, which is indexed by the screen-space normal
+inline uint16_t envTexColor(const uint8_t* tex, const fm_vec3_t &norm, int mip)
+{
   // transform normal to screenspace normal
   float normX = -Math::dot(norm, right) * (0.4f) + 0.5f;
   float normY = Math::dot(norm, up) * 0.4f + 0.5f;
 
-  float angle = 1.0f - (Math::dot(norm, dir) * 0.5f + 0.5f);
-
   // Texturing
   float uv[2] {
     normX * TEX_DIM,
@@ -268,8 +410,19 @@ inline uint32_t shadeResultEnv(const fm_vec3_t &norm, const fm_vec3_t &hitPos, c
     (int)(uv[1]) & (TEX_DIM-1),
   };
 
-  uint16_t* texData = (uint16_t*)(MemMap::TEX3_CACHED);
-  uint16_t tex = texData[uvPixel[1] * TEX_DIM + uvPixel[0]];
+  return Tex::fetchCI8(tex,
+    Tex::mipOffset<TEX_DIM>(mip) + Tex::tiledIndex(uvPixel[0] >> mip, uvPixel[1] >> mip, TEX_DIM >> mip)
+  );
+}
+
+// fresnel towards white, 'tex' is the env-map color
+inline uint32_t shadeEnvFresnel(uint16_t tex, const fm_vec3_t &norm, const fm_vec3_t &dir, float dist)
+{
+  float distNorm = (renderDist - dist);
+  float distNormInv = distNorm * renderDistInv;
+  distNormInv = fminf((distNormInv * 2.0f), 1.0f);
+
+  float angle = 1.0f - (Math::dot(norm, dir) * 0.5f + 0.5f);
 
   fm_vec3_t col;
   col.x = (tex >> 11);
@@ -285,58 +438,52 @@ inline uint32_t shadeResultEnv(const fm_vec3_t &norm, const fm_vec3_t &hitPos, c
   ;
 }
 
+inline uint32_t shadeResultEnv(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int)
+{
+  int mip = Tex::mipLevel(dist, ENV_TEXELS_PER_UNIT);
+  uint16_t tex = envTexColor((const uint8_t*)MemMap::TEX3_CACHED, norm, mip);
+  return shadeEnvFresnel(tex, norm, dir, dist);
+}
+
+// projects a normalized direction onto the octahedron, the lower half is folded over the corners.
+// the result is in [-1, 1]
+inline void octaProject(const fm_vec3_t &dir, float &u, float &v)
+{
+  float l1Inv = 1.0f / (fabsf(dir.x) + fabsf(dir.y) + fabsf(dir.z));
+  u = dir.x * l1Inv;
+  v = dir.z * l1Inv;
+  if(dir.y < 0) {
+    float uOld = u;
+    u = (1.0f - fabsf(v)) * (uOld < 0 ? -1.0f : 1.0f);
+    v = (1.0f - fabsf(uOld)) * (v < 0 ? -1.0f : 1.0f);
+  }
+}
+
 inline uint16_t sampleSky(const fm_vec3_t &dir) {
-  float u = 0.5f + (atan2(dir.z, dir.x) / (2.0f * M_PI));
-  float v = 0.5f - (asin(dir.y) / M_PI);
-    
+  float u, v;
+  octaProject(dir, u, v);
+
+  constexpr float UV_SCALE = SKY_DIM * 0.5f;
   int uvSky[2] = {
-    (int)(u * SKY_WIDTH) & (SKY_WIDTH-1),
-    (int)(v * SKY_HEIGHT) & (SKY_HEIGHT-1),
+    std::min((int)((u + 1.0f) * UV_SCALE), SKY_DIM-1),
+    std::min((int)((v + 1.0f) * UV_SCALE), SKY_DIM-1),
   };
 
-  uint16_t* texSky = (uint16_t*)(MemMap::TEX_SKY_CACHED);
-  return texSky[uvSky[1] * SKY_WIDTH + uvSky[0]];
+  return Tex::fetchBlock((const uint32_t*)MemMap::TEX_SKY_CACHED, uvSky[0], uvSky[1], SKY_DIM);
 }
 
-inline uint32_t shadeResultEnv2(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist)
+inline uint32_t shadeResultEnv2(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int)
 {
   if(dist == 0) {
     return sampleSky(dir);
   }
 
-  // transform normal to screenspace normal
-  float normX = -Math::dot(norm, right) * (0.4f) + 0.5f;
-  float normY = Math::dot(norm, up) * 0.4f + 0.5f;
-
-  float angle = 1.0f - (Math::dot(norm, dir) * 0.5f + 0.5f);
-
-  // Texturing
-  float uv[2] {
-    normX * TEX_DIM,
-    normY * TEX_DIM,
-  };
-
-  int uvPixel[2] = {
-    (int)(uv[0]) & (TEX_DIM-1),
-    (int)(uv[1]) & (TEX_DIM-1),
-  };
-
-
-  uint16_t* texData = (uint16_t*)(MemMap::TEX3_CACHED + 0x20000);
-  uint16_t texColor = texData[uvPixel[1] * TEX_DIM + uvPixel[0]];
-
-  fm_vec3_t col;
-  col.x = (texColor >> 11);
-  col.y = (texColor >> 6) & 0b11111;
-  col.z = (texColor >> 1) & 0b11111;
-
-  return ((int)(col.x) << 11) |
-         ((int)(col.y) << 6) |
-         ((int)(col.z) << 1)
-  ;
+  // second texture, after the first one
+  int mip = Tex::mipLevel(dist, ENV_TEXELS_PER_UNIT);
+  return envTexColor((const uint8_t*)MemMap::TEX3_CACHED + Tex::CI8_BYTES, norm, mip) & ~1;
 }
 
-inline uint32_t shadeResultEnvSky(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist)
+inline uint32_t shadeResultEnvSky(const fm_vec3_t &norm, const fm_vec3_t &hitPos, const fm_vec3_t &dir, float dist, int)
 {
   fm_vec3_t normRef = dir;
   if(dist != 0) {
@@ -0,0 +1,124 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Full-res mode marching 16x16 tiles (the ones of 'lightGrid'),
+// the depth range of a tile then culls its lights further before it gets shaded.
+// Each tile is shaded while the RSP marches the next one, so the samples are double-buffered.
+
+struct TileSample {
+  fm_vec3_t dir;
+  float dist;
+  int material;
+};
+
+constinit TileSample tileSamples[2][LIGHT_TILE * LIGHT_TILE]{};
+
+/**
+ * Draws the frame in rows of tiles, returns the line it stopped at.
+ * Like 'drawGeneric()' it stops early if the remaining rows are projected to miss the frame-budget.
+ */
+template<SDFConf CONF>
+int drawTiledLights(void* fb)
+{
+  fm_vec3_t camPos = camera.camPos;
+  auto buff = (uint16_t*)((char*)fb + (OFFSET_Y * FB_STRIDE) + OFFSET_X*2);
+  uint32_t ticksStart = TICKS_READ();
+
+  // last marched tile, nothing of it is shaded yet
+  struct Tile {
+    int x0, y0, w, h;
+    uint32_t lightMask;
+    const TileSample *samples;
+  };
+  Tile pending{0, 0, 0, 0, 0, nullptr};
+  int sampleBuff = 0;
+
+  auto shadePending = [&](int i) {
+    const auto &sample = pending.samples[i];
+    buff[(pending.y0 + i / pending.w) * (FB_STRIDE/2) + pending.x0 + (i % pending.w)]
+      = shadeSample<CONF>(sample.dist, sample.dir, camPos, sample.material);
+  };
+
+  auto finish = [&](int line) {
+    tileLightMask = pending.lightMask;
+    for(int i=0; i<pending.w * pending.h; ++i)shadePending(i);
+    tileLightMask = (1u << lightCount) - 1;
+    tileLightMaskHasGrid = false;
+    return line;
+  };
+
+  tileLightMaskHasGrid = true;
+  for(int y0=0; y0<OUTPUT_HEIGHT; y0+=LIGHT_TILE) {
+    if(frameBudget != 0 && y0 != 0 && isOverBudget(ticksStart, y0, OUTPUT_HEIGHT - y0)) {
+      return finish(y0);
+    }
+
+    int h = std::min(LIGHT_TILE, OUTPUT_HEIGHT - y0);
+    for(int x0=0; x0<OUTPUT_WIDTH; x0+=LIGHT_TILE)
+    {
+      int w = std::min(LIGHT_TILE, OUTPUT_WIDTH - x0);
+      auto tileDir = rayStepY * (float)y0 + rayStepX * (float)x0 + rayDirOrigin;
+      TileSample *samples = tileSamples[sampleBuff];
+      sampleBuff ^= 1;
+
+      // shades a pixel of the last tile per sample, edge tiles can have fewer samples than that
+      int pendingCount = pending.w * pending.h;
+      tileLightMask = pending.lightMask;
+
+      float zMin = renderDist;
+      float zMax = 0;
+      marchSamples<CONF>(w * h,
+        [&](int i) { return rayStepY * (float)(i / w) + rayStepX * (float)(i % w) + tileDir; },
+        [&](int i, float distTotal, const fm_vec3_t &dir, int material) {
+          samples[i] = {dir, distTotal, material};
+          if(distTotal < renderDist) {
+            zMin = fminf(zMin, distTotal);
+            zMax = fmaxf(zMax, distTotal);
+          }
+          if(i < pendingCount)shadePending(i);
+        }
+      );
+      for(int i=w*h; i<pendingCount; ++i)shadePending(i);
+
+      // box around the part of the tile's frustum that has hits. All of them are within the pyramid of
+      // the corner rays, and between the planes at a distance of 'zMin * cos(half-angle)' and 'zMax' along
+      // the center ray. The far plane has to be at 'zMax' since hits in the middle of the tile bulge out
+      // further than at the corners, so the box is taken around that frustum.
+      uint32_t lightMask = 0;
+      if(zMax > 0) {
+        const fm_vec3_t corners[4]{
+          tileDir, tileDir + rayStepX * (float)w,
+          tileDir + rayStepY * (float)h, tileDir + rayStepX * (float)w + rayStepY * (float)h,
+        };
+        auto axis = Math::normalizeUnsafe(tileDir + rayStepX * (w * 0.5f) + rayStepY * (h * 0.5f));
+
+        fm_vec3_t cornerDirs[4];
+        float cosT = 1.0f;
+        for(int c=0; c<4; ++c) {
+          cornerDirs[c] = Math::normalizeUnsafe(corners[c]);
+          cosT = fminf(cosT, Math::dot(cornerDirs[c], axis));
+        }
+
+        fm_vec3_t bbMin{INFINITY, INFINITY, INFINITY};
+        fm_vec3_t bbMax{-INFINITY, -INFINITY, -INFINITY};
+        for(const auto &dir : cornerDirs) {
+          // distance along the corner ray to reach the planes
+          float cosC = Math::dot(dir, axis);
+          for(float z : {zMin * cosT, zMax}) {
+            auto p = camPos + dir * (z / cosC);
+            bbMin = {fminf(bbMin.x, p.x), fminf(bbMin.y, p.y), fminf(bbMin.z, p.z)};
+            bbMax = {fmaxf(bbMax.x, p.x), fmaxf(bbMax.y, p.y), fmaxf(bbMax.z, p.z)};
+          }
+        }
+        // the tiles match the ones of 'lightGrid', so its mask is applied once here instead of per pixel
+        lightMask = cullLights(bbMin, bbMax) & lightGrid[y0 / LIGHT_TILE][x0 / LIGHT_TILE];
+      }
+
+      pending = {x0, y0, w, h, lightMask, samples};
+    }
+  }
+  return finish(OUTPUT_HEIGHT);
+}
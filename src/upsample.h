@@ -0,0 +1,80 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+
+// Reconstruction of SIZE x SIZE blocks from the samples at their corners (top-left is the block's own one).
+// Corners are passed as top-left, top-right, bottom-left, bottom-right.
+
+inline bool isDepthSimilar(uint32_t z, uint32_t zRef) {
+  if(z == DEPTH_MISS || zRef == DEPTH_MISS)return z == zRef;
+  uint32_t zDiff = z > zRef ? (z - zRef) : (zRef - z);
+  return zDiff*16 < zRef;
+}
+
+template<int SIZE>
+inline void interpolateBlock(uint16_t *buff, uint16_t c00, uint16_t c10, uint16_t c01, uint16_t c11)
+{
+  // scales the bilinear weights to a sum of 16
+  constexpr uint32_t W = 16 / (SIZE*SIZE);
+  static_assert(W * SIZE*SIZE == 16);
+
+  uint32_t s00 = Color::spread(c00) * W;
+  uint32_t s10 = Color::spread(c10) * W;
+  uint32_t s01 = Color::spread(c01) * W;
+  uint32_t s11 = Color::spread(c11) * W;
+
+  for(int v=0; v<SIZE; ++v) {
+    uint32_t left  = s00 * (SIZE - v) + s01 * v;
+    uint32_t right = s10 * (SIZE - v) + s11 * v;
+    for(int u=0; u<SIZE; ++u) {
+      buff[u] = Color::packSpread(left * (SIZE - u) + right * u);
+    }
+    buff += FB_STRIDE/2;
+  }
+}
+
+/**
+ * Joint-bilateral upsampling guided by the depth of the corners.
+ * Coherent blocks are interpolated, otherwise each pixel only blends the corners
+ * that are at the depth of its nearest one, so silhouettes stay sharp without getting blocky.
+ */
+template<int SIZE>
+inline void upsampleBlock(uint16_t *buff, const uint16_t c[4], const uint16_t z[4])
+{
+  bool isCoherent = isDepthSimilar(z[1], z[0]) && isDepthSimilar(z[2], z[0]) && isDepthSimilar(z[3], z[0]);
+  if(isCoherent) {
+    interpolateBlock<SIZE>(buff, c[0], c[1], c[2], c[3]);
+    return;
+  }
+
+  const uint32_t s[4]{Color::spread(c[0]), Color::spread(c[1]), Color::spread(c[2]), Color::spread(c[3])};
+
+  for(int v=0; v<SIZE; ++v) {
+    for(int u=0; u<SIZE; ++u) {
+      const uint32_t w[4]{
+        (uint32_t)((SIZE - u) * (SIZE - v)), (uint32_t)(u * (SIZE - v)),
+        (uint32_t)((SIZE - u) * v),          (uint32_t)(u * v)
+      };
+      uint32_t zRef = z[(u*2 >= SIZE ? 1 : 0) + (v*2 >= SIZE ? 2 : 0)];
+
+      uint32_t sum = 0;
+      uint32_t weight = 0;
+      for(int k=0; k<4; ++k) {
+        if(isDepthSimilar(z[k], zRef)) {
+          sum += s[k] * w[k];
+          weight += w[k];
+        }
+      }
+
+      // only edge pixels get here, so the division is fine
+      uint32_t scale = 4096 / weight;
+      uint32_t r = (((sum >> 20) & 0x3FF) * scale) >> 12;
+      uint32_t g = (((sum >> 10) & 0x3FF) * scale) >> 12;
+      uint32_t b = (((sum >>  0) & 0x3FF) * scale) >> 12;
+      buff[u] = (r << 11) | (g << 6) | (b << 1);
+    }
+    buff += FB_STRIDE/2;
+  }
+}
@@ -5,6 +5,7 @@
 #include <cmath>
 #include <limits>
 #include <cstdlib>
+#include <algorithm>
 #include <iostream>
 #include "lodepng.h"
 
@@ -19,10 +20,282 @@ namespace
   uint16_t packRGBA556(uint8_t r, uint8_t g, uint8_t b) {
     return (((int)r >> 3) << 11) | (((int)g >> 3) << 6) | (((int)b >> 2));
   }
+
+  // size of the octahedral sky, must match 'SKY_DIM' in the shading code
+  constexpr uint32_t SKY_DIM = 512;
+  constexpr uint32_t TILE_DIM = 4;
+
+  // texels are stored in 4x4 tiles, each tile row-major, tiles row-major (same as 'Tex::tiledIndex()')
+  uint32_t tiledIndex(uint32_t x, uint32_t y, uint32_t dim) {
+    uint32_t tile = (y / TILE_DIM) * (dim / TILE_DIM) + (x / TILE_DIM);
+    return tile * (TILE_DIM*TILE_DIM) + (y % TILE_DIM) * TILE_DIM + (x % TILE_DIM);
+  }
+
+  // calls 'fn(x, y)' for each texel in the order of 'tiledIndex()'
+  template<typename FN>
+  void forEachTiled(unsigned width, unsigned height, FN fn) {
+    assert(width % TILE_DIM == 0 && height % TILE_DIM == 0);
+    for(unsigned ty = 0; ty < height; ty += TILE_DIM) {
+      for(unsigned tx = 0; tx < width; tx += TILE_DIM) {
+        for(unsigned y = ty; y < ty + TILE_DIM; ++y) {
+          for(unsigned x = tx; x < tx + TILE_DIM; ++x)fn(x, y);
+        }
+      }
+    }
+  }
+
+  // mip levels of material textures, down to a single tile (must match 'Tex::MIP_LEVELS')
+  constexpr uint32_t MIP_LEVELS = 7;
+
+  struct Level {
+    unsigned dim;
+    vector<float> col;  // RGB, 0-255
+    vector<float> norm; // XYZ in the encoding of the source image (0-255), empty for color-only textures
+  };
+
+  uint8_t toU8(float v) {
+    return (uint8_t)std::clamp(lroundf(v), 0L, 255L);
+  }
+
+  Level loadLevel(const uint8_t *dataCol, const uint8_t *dataNorm, unsigned dim)
+  {
+    Level res{dim, vector<float>(dim*dim*3), vector<float>(dataNorm ? dim*dim*3 : 0)};
+    for(unsigned i = 0; i < dim*dim; ++i) {
+      for(unsigned c = 0; c < 3; ++c) {
+        res.col[i*3 + c] = dataCol[i*4 + c];
+        if(dataNorm)res.norm[i*3 + c] = dataNorm[i*4 + c];
+      }
+    }
+    return res;
+  }
+
+  // 2x2 box-filter, normals are averaged as vectors and renormalized
+  Level downsample(const Level &src)
+  {
+    unsigned dim = src.dim / 2;
+    Level res{dim, vector<float>(dim*dim*3), vector<float>(src.norm.empty() ? 0 : dim*dim*3)};
+
+    for(unsigned y = 0; y < dim; ++y) {
+      for(unsigned x = 0; x < dim; ++x) {
+        float col[3]{0,0,0};
+        float norm[3]{0,0,0};
+        for(unsigned s = 0; s < 4; ++s) {
+          unsigned idxSrc = ((y*2 + s/2) * src.dim + (x*2 + s%2)) * 3;
+          for(unsigned c = 0; c < 3; ++c) {
+            col[c] += src.col[idxSrc + c] * 0.25f;
+            if(!src.norm.empty())norm[c] += src.norm[idxSrc + c] / 127.5f - 1.0f;
+          }
+        }
+
+        unsigned idx = (y * dim + x) * 3;
+        float len = sqrtf(norm[0]*norm[0] + norm[1]*norm[1] + norm[2]*norm[2]);
+        for(unsigned c = 0; c < 3; ++c) {
+          res.col[idx + c] = col[c];
+          if(!src.norm.empty())res.norm[idx + c] = (len > 0 ? norm[c] / len : 0) * 127.5f + 127.5f;
+        }
+      }
+    }
+    return res;
+  }
+
+  vector<Level> createMipChain(Level base)
+  {
+    assert((base.dim >> (MIP_LEVELS-1)) >= TILE_DIM);
+    vector<Level> levels{std::move(base)};
+    while(levels.size() < MIP_LEVELS) {
+      levels.push_back(downsample(levels.back()));
+    }
+    return levels;
+  }
+
+  // channels of a RGBA556 color
+  array<int, 3> unpack556(uint16_t c) {
+    return {c >> 11, (c >> 6) & 0x1F, c & 0x3F};
+  }
+
+  int colorDistSq(const array<int, 3> &a, const array<int, 3> &b) {
+    int dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+    return dr*dr + dg*dg + db*db;
+  }
+
+  /**
+   * Median-cut quantization to (up to) 256 colors.
+   * Keeps splitting the box with the largest range along that channel.
+   */
+  vector<uint16_t> createPalette(const vector<uint16_t> &cols)
+  {
+    vector<vector<uint16_t>> boxes{cols};
+    while(boxes.size() < 256)
+    {
+      int bestBox = -1, bestRange = 0, bestCh = 0;
+      for(size_t b = 0; b < boxes.size(); ++b) {
+        for(int ch = 0; ch < 3; ++ch) {
+          int minVal = 0xFF, maxVal = 0;
+          for(uint16_t c : boxes[b]) {
+            int v = unpack556(c)[ch];
+            minVal = std::min(minVal, v);
+            maxVal = std::max(maxVal, v);
+          }
+          if(maxVal - minVal > bestRange) {
+            bestRange = maxVal - minVal;
+            bestBox = b;
+            bestCh = ch;
+          }
+        }
+      }
+      if(bestBox < 0)break; // every box is a single color
+
+      auto &box = boxes[bestBox];
+      std::sort(box.begin(), box.end(), [&](uint16_t a, uint16_t b) {
+        return unpack556(a)[bestCh] < unpack556(b)[bestCh];
+      });
+      vector<uint16_t> upper(box.begin() + box.size()/2, box.end());
+      box.resize(box.size()/2);
+      boxes.push_back(std::move(upper));
+    }
+
+    vector<uint16_t> palette(256, 0);
+    for(size_t b = 0; b < boxes.size(); ++b) {
+      array<uint32_t, 3> sum{0,0,0};
+      for(uint16_t c : boxes[b]) {
+        auto ch = unpack556(c);
+        for(int i = 0; i < 3; ++i)sum[i] += ch[i];
+      }
+      uint32_t count = boxes[b].size();
+      palette[b] = ((sum[0] / count) << 11) | ((sum[1] / count) << 6) | (sum[2] / count);
+    }
+    return palette;
+  }
+
+  vector<uint8_t> applyPalette(const vector<uint16_t> &cols, const vector<uint16_t> &palette)
+  {
+    vector<int> cache(0x10000, -1);
+    vector<uint8_t> res;
+    res.reserve(cols.size());
+    for(uint16_t c : cols) {
+      if(cache[c] < 0) {
+        int bestDist = numeric_limits<int>::max();
+        for(int i = 0; i < (int)palette.size(); ++i) {
+          int dist = colorDistSq(unpack556(c), unpack556(palette[i]));
+          if(dist < bestDist) {
+            bestDist = dist;
+            cache[c] = i;
+          }
+        }
+      }
+      res.push_back(cache[c]);
+    }
+    return res;
+  }
+
+  // weights (in 1/16) of the second endpoint, must match 'Tex::BLOCK_WEIGHTS'
+  constexpr int BLOCK_WEIGHTS[4] = {0, 5, 11, 16};
+
+  // same as the runtime decode, which works on 5 bits per channel
+  array<int, 3> blockColor(uint16_t c0, uint16_t c1, int weight) {
+    auto a = unpack556(c0);
+    auto b = unpack556(c1);
+    array<int, 3> res;
+    for(int i = 0; i < 3; ++i) {
+      int va = i == 2 ? (a[i] >> 1) : a[i];
+      int vb = i == 2 ? (b[i] >> 1) : b[i];
+      res[i] = (va * (16 - weight) + vb * weight) >> 4;
+    }
+    return res;
+  }
+
+  /**
+   * Compresses 16 texels (one tile) into two endpoints and a 2-bit weight per texel.
+   * The endpoints are the texels furthest apart along the diagonal of the bounding box.
+   */
+  void compressBlock(const uint16_t *cols, uint16_t &c0, uint16_t &c1, uint32_t &weights)
+  {
+    array<int, 3> minCh{0xFF, 0xFF, 0xFF}, maxCh{0, 0, 0};
+    for(int i = 0; i < 16; ++i) {
+      auto ch = unpack556(cols[i]);
+      for(int c = 0; c < 3; ++c) {
+        minCh[c] = std::min(minCh[c], ch[c]);
+        maxCh[c] = std::max(maxCh[c], ch[c]);
+      }
+    }
+
+    int projMin = numeric_limits<int>::max(), projMax = numeric_limits<int>::min();
+    c0 = c1 = cols[0];
+    for(int i = 0; i < 16; ++i) {
+      auto ch = unpack556(cols[i]);
+      int proj = 0;
+      for(int c = 0; c < 3; ++c)proj += ch[c] * (maxCh[c] - minCh[c]);
+      if(proj < projMin) { projMin = proj; c0 = cols[i]; }
+      if(proj > projMax) { projMax = proj; c1 = cols[i]; }
+    }
+
+    weights = 0;
+    for(int i = 0; i < 16; ++i) {
+      auto ch = unpack556(cols[i]);
+      array<int, 3> target{ch[0], ch[1], ch[2] >> 1};
+      int best = 0, bestDist = numeric_limits<int>::max();
+      for(int w = 0; w < 4; ++w) {
+        int dist = colorDistSq(target, blockColor(c0, c1, BLOCK_WEIGHTS[w]));
+        if(dist < bestDist) { bestDist = dist; best = w; }
+      }
+      weights |= best << (i * 2);
+    }
+  }
+
+  /**
+   * Converts an equirectangular panorama into an octahedral map (upper hemisphere in the center).
+   * Each texel is the average of 4x4 samples of the panorama along its footprint.
+   */
+  vector<uint16_t> convertOctahedral(const uint8_t *data, unsigned width, unsigned height)
+  {
+    constexpr int SUB_SAMPLES = 4;
+    vector<uint16_t> res(SKY_DIM * SKY_DIM);
+
+    auto sampleEquirect = [&](float x, float y, float z, uint32_t *col) {
+      // same mapping the old runtime lookup used
+      float u = 0.5f + (atan2f(z, x) / (2.0f * (float)M_PI));
+      float v = 0.5f - (asinf(y) / (float)M_PI);
+      unsigned px = std::min((unsigned)(u * width), width-1);
+      unsigned py = std::min((unsigned)(v * height), height-1);
+      const uint8_t *p = data + (py * width + px) * 4;
+      col[0] += p[0]; col[1] += p[1]; col[2] += p[2];
+    };
+
+    for(uint32_t y = 0; y < SKY_DIM; ++y) {
+      for(uint32_t x = 0; x < SKY_DIM; ++x) {
+        uint32_t col[3]{0,0,0};
+        for(int sy = 0; sy < SUB_SAMPLES; ++sy) {
+          for(int sx = 0; sx < SUB_SAMPLES; ++sx) {
+            float u = ((x + (sx + 0.5f) / SUB_SAMPLES) / SKY_DIM) * 2.0f - 1.0f;
+            float v = ((y + (sy + 0.5f) / SUB_SAMPLES) / SKY_DIM) * 2.0f - 1.0f;
+
+            float dx = u;
+            float dz = v;
+            float dy = 1.0f - fabsf(u) - fabsf(v);
+            if(dy < 0) {
+              dx = (1.0f - fabsf(v)) * (u < 0 ? -1.0f : 1.0f);
+              dz = (1.0f - fabsf(u)) * (v < 0 ? -1.0f : 1.0f);
+            }
+            float len = sqrtf(dx*dx + dy*dy + dz*dz);
+            sampleEquirect(dx / len, dy / len, dz / len, col);
+          }
+        }
+
+        constexpr uint32_t COUNT = SUB_SAMPLES * SUB_SAMPLES;
+        res[tiledIndex(x, y, SKY_DIM)] = packRGBA556(col[0] / COUNT, col[1] / COUNT, col[2] / COUNT);
+      }
+    }
+    return res;
+  }
 }
 
-void processPNG(const string& fileTex, const string& fileOut, bool texOnly)
+/**
+ * 'mode' selects the content, 'format' the encoding of color-only textures:
+ * 0: raw RGBA556, 'p': CI8 (palette + indices), 'b': block-compressed (8 bytes per 4x4 tile)
+ */
+void processPNG(const string& fileTex, const string& fileOut, char mode, char format)
 {
+  bool texOnly = mode == 'c';
   vector<unsigned char> image;
   unsigned width, height;
 
@@ -37,6 +310,31 @@ void processPNG(const string& fileTex, const string& fileOut, bool texOnly)
   auto writeS8 = [pFile](int8_t val) {
     fwrite(&val, 1, 1, pFile);
   };
+  auto writeU32 = [&](uint32_t val) {
+    writeU16(val >> 16);
+    writeU16(val & 0xFFFF);
+  };
+
+  // writes color-only texels (already in tiled order) in the requested format
+  auto writeColors = [&](const vector<uint16_t> &cols) {
+    if(format == 'p') {
+      auto palette = createPalette(cols);
+      for(uint16_t c : palette)writeU16(c);
+      for(uint8_t idx : applyPalette(cols, palette))writeS8(idx);
+    } else if(format == 'b') {
+      assert(cols.size() % 16 == 0);
+      for(size_t i = 0; i < cols.size(); i += 16) {
+        uint16_t c0, c1;
+        uint32_t weights;
+        compressBlock(&cols[i], c0, c1, weights);
+        writeU16(c0);
+        writeU16(c1);
+        writeU32(weights);
+      }
+    } else {
+      for(uint16_t c : cols)writeU16(c);
+    }
+  };
 
     unsigned error = lodepng::decode(image, width, height, fileTex);
     if (error) {
@@ -51,33 +349,49 @@ void processPNG(const string& fileTex, const string& fileOut, bool texOnly)
   uint8_t *dataCol = image.data();
   uint8_t *dataNorm = image.data() + idxNorm;
 
-  if(texOnly) 
+  // all textures are written in tiles, see 'Tex::tiledIndex()' in the shading code.
+  // material textures are followed by their mip-chain, each level in the same format and layout
+
+  if(mode == 'o')
+  {
+    writeColors(convertOctahedral(dataCol, width, height));
+  } else if(texOnly) 
   {
-    for(unsigned y = 0; y < height; ++y) 
+    // multiple square textures can be stacked vertically
+    assert(height % width == 0);
+    for(unsigned t = 0; t < height / width; ++t)
     {
-      for(unsigned x = 0; x < width; ++x) 
-      {
-        writeU16(packRGBA556(dataCol[0],dataCol[1],dataCol[2]));
-        dataCol += 4;
+      // the whole chain is encoded at once, so it shares one palette
+      vector<uint16_t> cols;
+      auto levels = createMipChain(loadLevel(dataCol + t * width * width * 4, nullptr, width));
+      for(auto &level : levels) {
+        forEachTiled(level.dim, level.dim, [&](unsigned x, unsigned y) {
+          const float *col = &level.col[(y * level.dim + x) * 3];
+          cols.push_back(packRGBA556(toU8(col[0]), toU8(col[1]), toU8(col[2])));
+        });
       }
+      writeColors(cols);
     }
   } else {
     assert(width == TEX_DIM);
     assert(height == TEX_DIM*2);
 
-    for(unsigned y = 0; y < TEX_DIM; ++y) 
-    {
-      for(unsigned x = 0; x < TEX_DIM; ++x) 
-      {
-        writeS8(dataNorm[0] - 127);
-        writeS8(dataNorm[1] - 127);
-        
-        bool isDefNorm = dataNorm[2] >= 252;
-        writeU16(packRGBA5515(dataCol[0],dataCol[1],dataCol[2], isDefNorm));
-
-        dataCol += 4;
-        dataNorm += 4;
-      }
+    // separate planes: all colors first, then all normals, each with the same mip-chain & tiling
+    auto levels = createMipChain(loadLevel(dataCol, dataNorm, TEX_DIM));
+    for(auto &level : levels) {
+      forEachTiled(level.dim, level.dim, [&](unsigned x, unsigned y) {
+        unsigned idx = (y * level.dim + x) * 3;
+        const float *col = &level.col[idx];
+        bool isDefNorm = toU8(level.norm[idx + 2]) >= 252;
+        writeU16(packRGBA5515(toU8(col[0]), toU8(col[1]), toU8(col[2]), isDefNorm));
+      });
+    }
+    for(auto &level : levels) {
+      forEachTiled(level.dim, level.dim, [&](unsigned x, unsigned y) {
+        const float *norm = &level.norm[(y * level.dim + x) * 3];
+        writeS8(toU8(norm[0]) - 127);
+        writeS8(toU8(norm[1]) - 127);
+      });
     }
   }
 
@@ -86,9 +400,11 @@ void processPNG(const string& fileTex, const string& fileOut, bool texOnly)
 
 int main(int argc, char* argv[]) {
     if (argc < 4) {
-        cerr << "Usage: " << argv[0] << " <texture.png> <output> [c,n]\n";
+        cerr << "Usage: " << argv[0] << " <texture.png> <output> [c,n,o][p,b]\n";
+        cerr << "  c: color only, n: color + normals, o: color only as an octahedral map\n";
+        cerr << "  color only can be followed by p: CI8 palette, b: block-compressed\n";
         return 1;
     }
-    processPNG(argv[1], argv[2], argv[3][0] == 'c');
+    processPNG(argv[1], argv[2], argv[3][0], argv[3][1]);
     return 0;
 }
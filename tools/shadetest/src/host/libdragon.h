@@ -0,0 +1,24 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#pragma once
+// Minimal host version of the libdragon API used by the shading code, only for tests.
+#include <cstdint>
+#include <cmath>
+#include <bit>
+
+typedef union {
+  float v[3];
+  struct { float x, y, z; };
+} fm_vec3_t;
+
+typedef struct {
+  uint8_t r, g, b, a;
+} color_t;
+
+inline float fm_sinf(float x) { return sinf(x); }
+inline float fm_cosf(float x) { return cosf(x); }
+inline float fm_atan2f(float y, float x) { return atan2f(y, x); }
+inline float fm_floorf(float x) { return floorf(x); }
+inline float fm_fmodf(float x, float y) { return fmodf(x, y); }
@@ -0,0 +1,164 @@
+/**
+* @copyright 2025 - Max Bebök
+* @license MIT
+*/
+#include <libdragon.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <sys/mman.h>
+#include "main.h"
+#include "math/mathFloat.h"
+
+/**
+ * Checks the fixed-point shaders composed in 'shadeStages.h' against the float versions in 'shading.h'.
+ * Both are run for random hits, every channel has to be within one LSB (RGBA5551).
+ */
+
+FlyCam camera{};
+
+namespace
+{
+  // globals of 'raymarch.cpp' the shaders read
+  constinit fm_vec3_t lightPos{};
+  constinit fm_vec3_t right{};
+  constinit fm_vec3_t up{};
+  constinit fm_vec3_t rayDirOrigin{};
+  constinit fm_vec3_t rayStepX{};
+  constinit fm_vec3_t rayStepY{};
+  constinit float pixelSize = 1.0f / OUTPUT_HEIGHT;
+  constinit float renderDist = RENDER_DIST;
+  constinit float renderDistInv = 1.0f / RENDER_DIST;
+
+  #include "sdfConf.h"
+  #include "colorFP.h"
+  #include "palette.h"
+  #include "shading.h"
+  #include "normalLut.h"
+  #include "faceCache.h"
+  #include "lights.h"
+  #include "cellVolume.h"
+  #include "shadeStages.h"
+
+  constexpr int SAMPLES = 200'000;
+  constexpr int MAX_ERROR = 1;
+
+  struct Hit {
+    fm_vec3_t norm;
+    fm_vec3_t hitPos;
+    fm_vec3_t dir;
+    float dist;
+  };
+
+  std::mt19937 rng{1234};
+
+  float random(float min, float max) {
+    return std::uniform_real_distribution<float>{min, max}(rng);
+  }
+
+  fm_vec3_t randomDir() {
+    return Math::normalize({random(-1, 1), random(-1, 1), random(-1, 1)});
+  }
+
+  Hit randomHit() {
+    return {
+      randomDir(),
+      {random(-8, 8), random(-8, 8), random(-8, 8)},
+      randomDir(),
+      random(0, renderDist)
+    };
+  }
+
+  // largest difference of the 5-bit channels
+  int colorError(uint16_t a, uint16_t b) {
+    int err = 0;
+    for(int shift : {11, 6, 1}) {
+      int diff = ((a >> shift) & 0b11111) - ((b >> shift) & 0b11111);
+      err = std::max(err, diff < 0 ? -diff : diff);
+    }
+    return err;
+  }
+
+  template<typename FN_REF, typename FN_FP>
+  bool compare(const char* name, FN_REF fnRef, FN_FP fnFP)
+  {
+    int maxError = 0;
+    int exact = 0;
+    Hit worst{};
+    for(int i=0; i<SAMPLES; ++i) {
+      Hit hit = randomHit();
+      int err = colorError(fnRef(hit), fnFP(hit));
+      if(err == 0)++exact;
+      if(err > maxError) {
+        maxError = err;
+        worst = hit;
+      }
+    }
+
+    bool ok = maxError <= MAX_ERROR;
+    printf("%-16s max. error: %d LSB, exact: %5.1f%% %s\n",
+      name, maxError, exact * 100.0f / SAMPLES, ok ? "OK" : "FAILED"
+    );
+    if(!ok) {
+      printf("  worst: norm=(%f %f %f) pos=(%f %f %f) dir=(%f %f %f) dist=%f\n",
+        worst.norm.x, worst.norm.y, worst.norm.z,
+        worst.hitPos.x, worst.hitPos.y, worst.hitPos.z,
+        worst.dir.x, worst.dir.y, worst.dir.z, worst.dist
+      );
+    }
+    return ok;
+  }
+}
+
+int main()
+{
+  bakePalettes();
+
+  // any content works, both versions read the same LUT entry
+  normalLutFunc = [](const fm_vec3_t &norm) {
+    return (uint16_t)(std::hash<float>{}(norm.x + norm.y * 3.0f + norm.z * 7.0f) & 0xFFFE);
+  };
+  invalidateNormalLut();
+
+  // the textures are read from their fixed N64 addresses, map those and fill them with noise
+  constexpr uint32_t TEX_START = MemMap::TEX0_CACHED;
+  constexpr uint32_t TEX_END = MemMap::TEX2_CACHED + TEXTURE_BYTES;
+  void* tex = mmap((void*)(uintptr_t)TEX_START, TEX_END - TEX_START, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if(tex != (void*)(uintptr_t)TEX_START) {
+    printf("failed to map the textures at 0x%08X\n", TEX_START);
+    return 1;
+  }
+  for(uint32_t i=0; i<(TEX_END - TEX_START)/4; ++i) {
+    ((uint32_t*)tex)[i] = rng();
+  }
+  lightPos = randomDir();
+
+  bool ok = true;
+  for(float dist : {11.0f, 5.0f}) {
+    renderDist = dist;
+    renderDistInv = 1.0f / dist;
+    printf("render distance %.1f:\n", dist);
+
+    ok &= compare("cylinder",
+      [](const Hit &h) { return shadeResultCylinder(h.norm, h.hitPos, h.dir, h.dist, 0); },
+      [](const Hit &h) { return shadeCylinderStages(h.norm, h.hitPos, h.dir, h.dist, 0); }
+    );
+    ok &= compare("flat",
+      [](const Hit &h) { return shadeResultFlat(h.norm, h.hitPos, h.dir, h.dist, 0); },
+      [](const Hit &h) { return shadeFlatStages(h.norm, h.hitPos, h.dir, h.dist, 0); }
+    );
+    ok &= compare("tex",
+      [](const Hit &h) { return shadeResultTex(h.norm, h.hitPos, h.dir, h.dist, 0); },
+      [](const Hit &h) { return shadeTexStages(h.norm, h.hitPos, h.dir, h.dist, 0); }
+    );
+    ok &= compare("env-fresnel",
+      [](const Hit &h) { return shadeEnvFresnel(normalLutColor(h.norm), h.norm, h.dir, h.dist); },
+      [](const Hit &h) { return shadeEnvLutStages(h.norm, h.hitPos, h.dir, h.dist, 0); }
+    );
+  }
+
+  return ok ? 0 : 1;
+}